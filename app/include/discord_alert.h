@@ -10,7 +10,23 @@ typedef char *(*AlertMsgProvider)(void *ctx);
 
 bool discordStart(void);
 void discordCleanup(void);
-void sendDiscordAlert(const char *webhookURL, const char *msg);
+// Returns true once the webhook answered 2xx; false means the alert was
+// not delivered and the caller may retry.
+bool sendDiscordAlert(const char *webhookURL, const char *msg);
+
+/* Delivery counters for the shared webhook sender. Latencies are the
+ * wall time of each curl_easy_perform() in microseconds;
+ * new_connections counts TCP/TLS connects (the rest reused keep-alive). */
+typedef struct {
+    long long sent;
+    long long failed;
+    long long new_connections;
+    long long last_us;
+    long long max_us;
+    long long total_us;
+} DiscordStats;
+
+void discord_get_stats(DiscordStats *out);
 
 /**
  * Bind Discord webhook traffic to a specific network device.
@@ -21,7 +37,11 @@ void sendDiscordAlert(const char *webhookURL, const char *msg);
  */
 void discord_set_device(const char *device);
 
-bool startDoorAlertMonitor(AlertMsgProvider provider, void *ctx, const char *webhook_url);
+/* The monitor subscribes to hub door/lock/online transitions for
+ * `module_id` (NULL = all modules), asks the provider for a message on each
+ * one and sends it. The initial state is reported once at start. */
+bool startDoorAlertMonitor(const char *module_id, AlertMsgProvider provider,
+                           void *ctx, const char *webhook_url);
 void stopDoorAlertMonitor(void);
 
 #endif // APP_DISCORD_ALERT_H
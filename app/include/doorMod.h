@@ -39,11 +39,51 @@ bool door_reporting_start(const char *hub_ip, uint16_t report_port, uint16_t hea
                           const char *module_id, int heartbeat_ms);
 void door_reporting_stop(void);
 
+/* Heartbeat timing since door_reporting_start(). Jitter is how late the
+ * module reactor woke up for each deadline; `missed` counts deadlines
+ * that passed before it could serve them and `piggybacked` the ones
+ * skipped because an EVENT or FEEDBACK had just gone to the hub.
+ * `period_ms` is the current period, between `interval_ms` and a third of
+ * the hub's liveness budget. */
+typedef struct {
+    int interval_ms;
+    int period_ms;
+    unsigned long sent;
+    unsigned long piggybacked;
+    unsigned long missed;
+    long long last_jitter_us;
+    long long mean_jitter_us;
+    long long max_jitter_us;
+} DoorHeartbeatStats;
+
+void door_heartbeat_stats(DoorHeartbeatStats *out);
+
+/* The background sensor sampler's door distance: the median of its last
+ * few valid readings, `age_ms` old (-1 before the first). Returns true if
+ * the estimate is fresh enough to act on; `running` is false before
+ * initializeDoorSystem() and after doorMod_cleanup(). */
+typedef struct {
+    bool running;
+    long long distance_cm;
+    long long age_ms;
+    unsigned long samples;
+    unsigned long errors;
+} DoorSensorEstimate;
+
+bool door_sensor_estimate(DoorSensorEstimate *out);
+
 /* Synchronous door control APIs. Operate on a caller-provided Door_t and
  * return the updated state by value. */
 Door_t lockDoor(Door_t *door);
 Door_t unlockDoor(Door_t *door);
 Door_t get_door_status(Door_t *door);
+
+/* Run "LOCK" or "UNLOCK" on the module's actuator worker after whatever it
+ * is already doing, and wait for the result. "STATUS" (anything else), or
+ * any action without door_reporting_start(), runs on the calling thread.
+ * If the worker's queue is full, or the module stops first, a LOCK or
+ * UNLOCK is not run and `*door` comes back unchanged. */
+Door_t door_local_command(const char *action, Door_t *door);
 void doorMod_cleanup(void);
 
 #endif /* APP_DOORMOD_H */
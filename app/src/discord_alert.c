@@ -9,6 +9,8 @@
 #include <net/if.h>
 
 #include "discord_alert.h"
+#include "hal/hub_bus.h"
+#include "hal/system_webhook.h"
 #include "hal/timing.h"
 
 /* Device binding for Discord webhook traffic (optional) */
@@ -74,108 +76,259 @@ void discord_set_device(const char *device)
     pthread_mutex_unlock(&g_discord_device_lock);
 }
 
-// Discord Alert sending handling using libcurl
-bool discordStart(void){
-    curl_global_init(CURL_GLOBAL_DEFAULT);
+// Discord Alert sending handling using libcurl.
+//
+// One long-lived easy handle is kept for the life of the process so that
+// the DNS cache, TLS session and the keep-alive connection to the webhook
+// host survive between alerts. All senders (hub, webhook worker, door
+// monitor) share it under g_curl_lock. The counters have their own
+// lock so discord_get_stats() never waits behind a slow webhook post.
+static pthread_mutex_t     g_curl_lock  = PTHREAD_MUTEX_INITIALIZER;
+static int                 g_curl_refs  = 0;
+static CURL               *g_curl       = NULL;
+static struct curl_slist  *g_headers    = NULL;
+static pthread_mutex_t     g_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static DiscordStats        g_stats;
+
+/* Configure the options that don't change between alerts. Called with
+ * g_curl_lock held. */
+static bool sender_open(void)
+{
+    if (g_curl) return true;
+
+    g_curl = curl_easy_init();
+    if (!g_curl) {
+        fprintf(stderr, "curl_easy_init() failed\n");
+        return false;
+    }
+    if (!g_headers) {
+        g_headers = curl_slist_append(NULL, "Content-Type: application/json");
+    }
+
+    curl_easy_setopt(g_curl, CURLOPT_HTTPHEADER, g_headers);
+    curl_easy_setopt(g_curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(g_curl, CURLOPT_TIMEOUT_MS, 10000L);
+    curl_easy_setopt(g_curl, CURLOPT_CONNECTTIMEOUT_MS, 5000L);
+    curl_easy_setopt(g_curl, CURLOPT_DNS_CACHE_TIMEOUT, 300L);
+    curl_easy_setopt(g_curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(g_curl, CURLOPT_TCP_KEEPIDLE, 60L);
+    curl_easy_setopt(g_curl, CURLOPT_TCP_KEEPINTVL, 30L);
+    curl_easy_setopt(g_curl, CURLOPT_MAXAGE_CONN, 600L);
+    /* HTTP/2 over TLS when the server offers it, HTTP/1.1 otherwise */
+    curl_easy_setopt(g_curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+
+    /* Set socket creation callback to bind to wlan0 if configured */
+    curl_easy_setopt(g_curl, CURLOPT_OPENSOCKETFUNCTION, socket_callback_bind_device);
+
+    /* Optional CA bundle, e.g. for a local HTTPS stand-in with a
+     * self-signed certificate. */
+    const char *cainfo = getenv("DISCORD_CAINFO");
+    if (cainfo && cainfo[0] != '\0') {
+        curl_easy_setopt(g_curl, CURLOPT_CAINFO, cainfo);
+    }
     return true;
 }
 
+static void sender_close(void)
+{
+    if (g_curl) {
+        curl_easy_cleanup(g_curl);
+        g_curl = NULL;
+    }
+    curl_slist_free_all(g_headers);
+    g_headers = NULL;
+}
+
+// Reference counted: the hub, the webhook worker and main() all call this.
+bool discordStart(void){
+    pthread_mutex_lock(&g_curl_lock);
+    if (g_curl_refs++ == 0) {
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+        pthread_mutex_lock(&g_stats_lock);
+        memset(&g_stats, 0, sizeof(g_stats));
+        pthread_mutex_unlock(&g_stats_lock);
+    }
+    bool ok = sender_open();
+    pthread_mutex_unlock(&g_curl_lock);
+    return ok;
+}
+
 void discordCleanup(void){
-    curl_global_cleanup();
+    pthread_mutex_lock(&g_curl_lock);
+    if (g_curl_refs > 0 && --g_curl_refs == 0) {
+        sender_close();
+        curl_global_cleanup();
+    }
+    pthread_mutex_unlock(&g_curl_lock);
 }
 
-void sendDiscordAlert(const char *webhook_url, const char *msg)
+void discord_get_stats(DiscordStats *out)
 {
-    if (!webhook_url || !msg) return;
-    CURL *curl = curl_easy_init();
-    if (!curl) {
-        fprintf(stderr, "curl_easy_init() failed\n");
-        return;
+    if (!out) return;
+    pthread_mutex_lock(&g_stats_lock);
+    *out = g_stats;
+    pthread_mutex_unlock(&g_stats_lock);
+}
+
+/* Escape msg into a JSON string body. Returns false if it doesn't fit. */
+static bool build_json_body(char *out, size_t cap, const char *msg)
+{
+    static const char prefix[] = "{\"content\":\"";
+    size_t n = sizeof(prefix) - 1;
+    if (cap < n + 3) return false;
+    memcpy(out, prefix, n);
+
+    for (const unsigned char *p = (const unsigned char *)msg; *p; p++) {
+        char esc[8];
+        size_t elen = 0;
+        switch (*p) {
+            case '"':  esc[0] = '\\'; esc[1] = '"';  elen = 2; break;
+            case '\\': esc[0] = '\\'; esc[1] = '\\'; elen = 2; break;
+            case '\n': esc[0] = '\\'; esc[1] = 'n';  elen = 2; break;
+            case '\r': esc[0] = '\\'; esc[1] = 'r';  elen = 2; break;
+            case '\t': esc[0] = '\\'; esc[1] = 't';  elen = 2; break;
+            default:
+                if (*p < 0x20) {
+                    elen = (size_t)snprintf(esc, sizeof(esc), "\\u%04x", *p);
+                } else {
+                    esc[0] = (char)*p; elen = 1;
+                }
+        }
+        if (n + elen + 3 > cap) return false;
+        memcpy(out + n, esc, elen);
+        n += elen;
     }
+    out[n++] = '"';
+    out[n++] = '}';
+    out[n] = '\0';
+    return true;
+}
+
+bool sendDiscordAlert(const char *webhook_url, const char *msg)
+{
+    if (!webhook_url || !msg) return false;
 
-    char json[512];
-    snprintf(json, sizeof(json), "{\"content\":\"%s\"}", msg);
+    char json[1024];
+    if (!build_json_body(json, sizeof(json), msg)) {
+        fprintf(stderr, "Discord: alert message too long, dropped\n");
+        return false;
+    }
 
-    struct curl_slist *headers = NULL;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
+    pthread_mutex_lock(&g_curl_lock);
+    if (!sender_open()) {
+        pthread_mutex_unlock(&g_curl_lock);
+        return false;
+    }
 
-    curl_easy_setopt(curl, CURLOPT_URL, webhook_url);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json);
-    
-    /* Set socket creation callback to bind to wlan0 if configured */
-    curl_easy_setopt(curl, CURLOPT_OPENSOCKETFUNCTION, socket_callback_bind_device);
+    curl_easy_setopt(g_curl, CURLOPT_URL, webhook_url);
+    curl_easy_setopt(g_curl, CURLOPT_POSTFIELDS, json);
+
+    long long t0 = getTimeInUs();
+    CURLcode res = curl_easy_perform(g_curl);
+    long long elapsed_us = getTimeInUs() - t0;
+
+    long new_conns = 0;
+    long http_code = 0;
+    curl_easy_getinfo(g_curl, CURLINFO_NUM_CONNECTS, &new_conns);
+    curl_easy_getinfo(g_curl, CURLINFO_RESPONSE_CODE, &http_code);
+    pthread_mutex_unlock(&g_curl_lock);
+
+    bool ok = res == CURLE_OK && http_code >= 200 && http_code < 300;
+
+    pthread_mutex_lock(&g_stats_lock);
+    g_stats.sent++;
+    g_stats.last_us = elapsed_us;
+    g_stats.total_us += elapsed_us;
+    if (elapsed_us > g_stats.max_us) g_stats.max_us = elapsed_us;
+    g_stats.new_connections += new_conns;
+    if (!ok) g_stats.failed++;
+    pthread_mutex_unlock(&g_stats_lock);
 
-    CURLcode res = curl_easy_perform(curl);
     if (res != CURLE_OK) {
         fprintf(stderr, "Discord webhook failed: %s\n", curl_easy_strerror(res));
+    } else if (!ok) {
+        fprintf(stderr, "Discord webhook failed: HTTP %ld\n", http_code);
     }
-
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
+    return ok;
 }
 
 // Door alert thread function. The provider callback returns a freshly
 // allocated string (or NULL). The app owns the provider and the
-// webhook URL.
+// webhook URL. The thread is a hub bus subscriber and blocks until the
+// watched module changes state, so it has no idle wakeups.
 typedef struct {
     AlertMsgProvider provider;
     void *provider_ctx;
     const char *webhook_url;
+    char module_id[HUB_MODULE_ID_LEN];   // empty = any module
+    HubBusSub *sub;
 } DoorMonitorCtx;
 
 static pthread_t        doorThreadId;
 static atomic_bool      doorThreadRunning = false;
 static DoorMonitorCtx  *g_ctx = NULL;
 
-void* doorAlertThread(void* arg) {
-    DoorMonitorCtx *ctx = (DoorMonitorCtx *)arg;
-    const char *webhook_url = ctx->webhook_url;
-    char *last_msg = NULL;
-
-    if (ctx->provider) {
-        char *m = ctx->provider(ctx->provider_ctx);
-        if (m) {
-            sendDiscordAlert(webhook_url, m);
-            last_msg = strdup(m);
-            free(m);
+static void door_monitor_alert(DoorMonitorCtx *ctx)
+{
+    if (!ctx->provider) return;
+    char *m = ctx->provider(ctx->provider_ctx);
+    if (m) {
+        // Through the retrying webhook queue when it runs, as hub alerts go.
+        if (hub_webhook_is_running()) {
+            hub_webhook_send(m);
+        } else {
+            sendDiscordAlert(ctx->webhook_url, m);
         }
+        free(m);
     }
+}
 
-    while (atomic_load(&doorThreadRunning)) {
-        if (ctx->provider) {
-            char *m = ctx->provider(ctx->provider_ctx);
-            if (m) {
-                if (!last_msg || strcmp(m, last_msg) != 0) {
-                    sendDiscordAlert(webhook_url, m);
-                    free(last_msg);
-                    last_msg = strdup(m);
-                }
-                free(m);
-            }
+void* doorAlertThread(void* arg) {
+    DoorMonitorCtx *ctx = (DoorMonitorCtx *)arg;
+
+    // Report the initial state once, then only on change.
+    door_monitor_alert(ctx);
+
+    HubBusEvent ev;
+    while (atomic_load(&doorThreadRunning) && hub_bus_wait(ctx->sub, &ev, -1)) {
+        if (ctx->module_id[0] != '\0' &&
+            strncmp(ev.module_id, ctx->module_id, sizeof(ctx->module_id)) != 0) {
+            continue;
         }
-        sleepForMs(500);
+        door_monitor_alert(ctx);
     }
-
-    free(last_msg);
     return NULL;
 }
 
-bool startDoorAlertMonitor(AlertMsgProvider provider, void *provider_ctx, const char *webhook_url) {
+bool startDoorAlertMonitor(const char *module_id, AlertMsgProvider provider,
+                           void *provider_ctx, const char *webhook_url) {
     if (atomic_load(&doorThreadRunning)) {
         return false;
     }
 
-    g_ctx = malloc(sizeof(DoorMonitorCtx));
+    g_ctx = calloc(1, sizeof(DoorMonitorCtx));
     if (!g_ctx) return false;
 
     g_ctx->provider = provider;
     g_ctx->provider_ctx = provider_ctx;
     g_ctx->webhook_url = webhook_url;
+    if (module_id) {
+        snprintf(g_ctx->module_id, sizeof(g_ctx->module_id), "%s", module_id);
+    }
+    g_ctx->sub = hub_bus_subscribe("door-monitor",
+                                   HUB_EV_DOOR | HUB_EV_LOCK |
+                                   HUB_EV_ONLINE | HUB_EV_OFFLINE,
+                                   32, HUB_BP_DROP_OLDEST);
+    if (!g_ctx->sub) {
+        free(g_ctx);
+        g_ctx = NULL;
+        return false;
+    }
 
     atomic_store(&doorThreadRunning, true);
     if (pthread_create(&doorThreadId, NULL, doorAlertThread, g_ctx) != 0) {
         atomic_store(&doorThreadRunning, false);
+        hub_bus_unsubscribe(g_ctx->sub);
         free(g_ctx);
         g_ctx = NULL;
         return false;
@@ -187,9 +340,11 @@ void stopDoorAlertMonitor() {
     if (!atomic_load(&doorThreadRunning)) return;
 
     atomic_store(&doorThreadRunning, false);
+    hub_bus_wake(g_ctx->sub);
     pthread_join(doorThreadId, NULL);
 
     if (g_ctx) {
+        hub_bus_unsubscribe(g_ctx->sub);
         free(g_ctx);
         g_ctx = NULL;
     }
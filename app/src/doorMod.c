@@ -12,18 +12,181 @@
 #include "hal/door_udp.h"
 /* app handler init prototype */
 extern bool app_udp_handler_init(void);
+extern void app_run_command(const char *module, int cmdid, const char *target, const char *action);
+extern void app_command_superseded(const char *module, int cmdid, const char *target, const char *action);
+extern void app_command_aborted(const char *module, int cmdid, const char *target, const char *action);
 #include <pthread.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <errno.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 
 #define DEBUG
+
+// --- Sensor sampler ---
+// One thread owns the ultrasonic sensor. It reads it every
+// DOOR_SENSOR_PERIOD_MS and publishes the median of the last
+// DOOR_SENSOR_WINDOW valid readings, stamped with when it was taken.
+// STATUS, the lock interlock and EVENT sampling all read that estimate
+// instead of waiting up to 60 ms on the echo pin; one older than
+// DOOR_SENSOR_MAX_AGE_MS counts as a sensor error.
+#define DOOR_SENSOR_PERIOD_MS  100
+#define DOOR_SENSOR_WINDOW     5
+#define DOOR_SENSOR_MAX_AGE_MS 500
+
+static pthread_t __sensor_thread;
+static bool __sensor_running = false;
+static pthread_mutex_t __sensor_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  __sensor_cond;   // CLOCK_MONOTONIC; signalled to stop
+static long long __sensor_window[DOOR_SENSOR_WINDOW];
+static int __sensor_filled = 0;
+static int __sensor_next = 0;
+static long long __sensor_estimate = -1;
+static long long __sensor_estimate_ms = 0;
+static unsigned long __sensor_samples = 0;
+static unsigned long __sensor_errors = 0;
+
+static long long sensor_now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000LL + now.tv_nsec / 1000000L;
+}
+
+// Fold one reading into the window. Called with __sensor_lock held.
+static void sensor_record(long long distance, long long now_ms)
+{
+    if (distance == -1) {
+        __sensor_errors++;
+        return;
+    }
+    __sensor_samples++;
+    __sensor_window[__sensor_next] = distance;
+    __sensor_next = (__sensor_next + 1) % DOOR_SENSOR_WINDOW;
+    if (__sensor_filled < DOOR_SENSOR_WINDOW) __sensor_filled++;
+
+    // Median of what we have: one stray echo can't flip open/closed.
+    long long sorted[DOOR_SENSOR_WINDOW];
+    for (int i = 0; i < __sensor_filled; i++) {
+        long long v = __sensor_window[i];
+        int j = i;
+        while (j > 0 && sorted[j - 1] > v) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+    __sensor_estimate = sorted[__sensor_filled / 2];
+    __sensor_estimate_ms = now_ms;
+}
+
+static void *sensor_sampler(void *arg)
+{
+    (void)arg;
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    pthread_mutex_lock(&__sensor_lock);
+    while (__sensor_running) {
+        pthread_mutex_unlock(&__sensor_lock);
+        long long distance = get_distance();
+        long long now_ms = sensor_now_ms();
+        pthread_mutex_lock(&__sensor_lock);
+        sensor_record(distance, now_ms);
+
+        // Absolute deadlines keep the period; after a stall, start over.
+        deadline.tv_nsec += DOOR_SENSOR_PERIOD_MS * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        long long deadline_ms = (long long)deadline.tv_sec * 1000LL + deadline.tv_nsec / 1000000L;
+        if (deadline_ms <= now_ms) {
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+        }
+        while (__sensor_running &&
+               pthread_cond_timedwait(&__sensor_cond, &__sensor_lock, &deadline) != ETIMEDOUT) {
+        }
+    }
+    pthread_mutex_unlock(&__sensor_lock);
+    return NULL;
+}
+
+static bool sensor_start(void)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&__sensor_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    __sensor_filled = __sensor_next = 0;
+    __sensor_estimate = -1;
+    __sensor_estimate_ms = 0;
+    __sensor_samples = __sensor_errors = 0;
+    // Take the first reading here so the estimate is valid on return.
+    sensor_record(get_distance(), sensor_now_ms());
+
+    __sensor_running = true;
+    if (pthread_create(&__sensor_thread, NULL, sensor_sampler, NULL) != 0) {
+        __sensor_running = false;
+        pthread_cond_destroy(&__sensor_cond);
+        return false;
+    }
+    return true;
+}
+
+static void sensor_stop(void)
+{
+    pthread_mutex_lock(&__sensor_lock);
+    bool running = __sensor_running;
+    __sensor_running = false;
+    pthread_cond_signal(&__sensor_cond);
+    pthread_mutex_unlock(&__sensor_lock);
+    if (running) {
+        pthread_join(__sensor_thread, NULL);
+        pthread_cond_destroy(&__sensor_cond);
+    }
+}
+
+bool door_sensor_estimate(DoorSensorEstimate *out)
+{
+    long long now_ms = sensor_now_ms();
+    pthread_mutex_lock(&__sensor_lock);
+    out->running = __sensor_running;
+    out->distance_cm = __sensor_estimate;
+    out->age_ms = (__sensor_estimate_ms > 0) ? now_ms - __sensor_estimate_ms : -1;
+    out->samples = __sensor_samples;
+    out->errors = __sensor_errors;
+    pthread_mutex_unlock(&__sensor_lock);
+    return out->running && out->distance_cm != -1 && out->age_ms >= 0 &&
+           out->age_ms <= DOOR_SENSOR_MAX_AGE_MS;
+}
+
+// The door distance in cm, or -1 on a sensor error. Served from the
+// sampler's estimate while it runs; without it, read the sensor directly.
+static long long door_distance(void)
+{
+    DoorSensorEstimate est;
+    if (door_sensor_estimate(&est)) return est.distance_cm;
+    return est.running ? -1 : get_distance();
+}
+
 // forward declaration for helper used below
 static void update_last_known_state(const Door_t *door);
 
+// Publishing the door state reads the stepper, which a lock or unlock moves
+// one step at a time. The reactor's periodic sample skips while the
+// actuator worker has a job (it reports when the job ends), and the lock
+// keeps the two from racing each other's EVENTs.
+static pthread_mutex_t __publish_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool __actuator_busy = false;
+static pthread_t __actuator_thread;
+
 // Small helper to map Door_t -> UDP booleans
 static void report_door_state_udp(Door_t *door)
 {
@@ -37,8 +200,8 @@ static void report_door_state_udp(Door_t *door)
     bool d1_open = false;   // unused for lock
     bool d1_locked = false;
 
-    // Door open/close from ultrasonic distance
-    long long distance = get_distance();
+    // Door open/close from the sampled ultrasonic distance
+    long long distance = door_distance();
     if (distance == -1) {
         // sensor error: don't send
         return;
@@ -46,11 +209,17 @@ static void report_door_state_udp(Door_t *door)
     // Threshold: distance >= 10 means open (matches existing logic)
     d0_open = (distance >= DOOR_CLOSED_THRESHOLD_CM);
 
-    // Lock state from stepper position: 180 = locked
-    d1_locked = (StepperMotor_GetPosition() == 180);
+    pthread_mutex_lock(&__publish_lock);
+    // A STATUS answered while the actuator moves the stepper leaves the
+    // publishing to the move, which reports when it ends.
+    if (!__actuator_busy || pthread_equal(pthread_self(), __actuator_thread)) {
+        // Lock state from stepper position: 180 = locked
+        d1_locked = (StepperMotor_GetPosition() == 180);
 
-    // Send mapping: D0 is door sensor; D1 is lock state
-    door_udp_update(d0_open, d0_locked, d1_open, d1_locked);
+        // Send mapping: D0 is door sensor; D1 is lock state
+        door_udp_update(d0_open, d0_locked, d1_open, d1_locked);
+    }
+    pthread_mutex_unlock(&__publish_lock);
 
     // Update last-known state/time for heartbeat using existing Door_t semantics
     update_last_known_state(door);
@@ -59,17 +228,69 @@ static void report_door_state_udp(Door_t *door)
 // forward declaration for helper used below
 static void update_last_known_state(const Door_t *door);
 
-// --- Heartbeat & reporting support ---
-static pthread_t __heartbeat_thread;
-static int __heartbeat_running = 0;
+// --- Module runtime ---
+// One reactor thread waits on everything a module reacts to: the command
+// socket, door_udp's EVENT retransmit timer, a heartbeat timerfd, a
+// sensor-sampling timerfd and an eventfd that stops it. Sampling reads the
+// sensor sampler's estimate, so it runs on the reactor; a lock or unlock
+// (seconds of stepper motion) goes to the actuator worker, which runs one
+// job at a time so the motor never has two users. An idle reactor only
+// wakes for its two timers.
+static pthread_t __reactor_thread;
+static volatile int __heartbeat_running = 0;
 static char *__report_module_id = NULL;
 static char __report_hub_ip[64];
 static uint16_t __heartbeat_port = 0;
 static int __heartbeat_interval_ms = 1000;
+static int __epfd = -1;
+static int __wakefd = -1;               // written once to stop the reactor
+static int __hb_timerfd = -1;
+static int __sample_timerfd = -1;
+static struct timespec __hb_deadline;   // when the next heartbeat is due
+static long long __hb_prev_deadline_ms; // the one before it (CLOCK_MONOTONIC)
 static pthread_mutex_t __door_state_lock = PTHREAD_MUTEX_INITIALIZER;
 static Door_t __last_known_door = { .state = UNKNOWN };
 static long long __last_report_time_ms = 0;
 
+// Heartbeat timing, written by the reactor thread only.
+static atomic_ulong     __hb_sent = 0;
+static atomic_ulong     __hb_missed = 0;
+static atomic_ulong     __hb_piggybacked = 0;
+static atomic_int       __hb_period_ms = 0;
+static atomic_llong     __hb_last_jitter_us = 0;
+static atomic_llong     __hb_max_jitter_us = 0;
+static atomic_llong     __hb_total_jitter_us = 0;
+
+// Actuator jobs, run in order by the actuator worker.
+typedef enum {
+    DOOR_JOB_REMOTE,        // COMMAND from the hub, answered with FEEDBACK
+    DOOR_JOB_LOCAL          // door_local_command(), which waits for it
+} DoorJobKind;
+
+typedef struct {
+    Door_t door;
+    bool   done;
+    bool   ran;             // false if dropped at shutdown
+} DoorLocalResult;
+
+typedef struct {
+    DoorJobKind kind;
+    int  cmdid;
+    char module[16];
+    char target[16];
+    char action[16];
+    DoorLocalResult *result;
+} DoorJob;
+
+#define DOOR_JOB_QUEUE_SIZE 16
+static DoorJob __jobs[DOOR_JOB_QUEUE_SIZE];
+static int __job_head = 0;
+static int __job_count = 0;
+static bool __actuator_running = false;
+static pthread_mutex_t __job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  __job_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  __job_done_cond = PTHREAD_COND_INITIALIZER;
+
 static void update_last_known_state(const Door_t *door)
 {
     pthread_mutex_lock(&__door_state_lock);
@@ -78,35 +299,380 @@ static void update_last_known_state(const Door_t *door)
     pthread_mutex_unlock(&__door_state_lock);
 }
 
-static void *heartbeat_worker(void *arg)
+static bool arm_timer(int fd, const struct timespec *first, int interval_ms);
+
+static void timespec_add_ms(struct timespec *t, long long ms)
+{
+    t->tv_sec += (time_t)(ms / 1000);
+    t->tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (t->tv_nsec >= 1000000000L) {
+        t->tv_sec++;
+        t->tv_nsec -= 1000000000L;
+    }
+}
+
+static long long timespec_diff_us(const struct timespec *a, const struct timespec *b)
+{
+    return (long long)(a->tv_sec - b->tv_sec) * 1000000LL +
+           (a->tv_nsec - b->tv_nsec) / 1000;
+}
+
+static long long timespec_ms(const struct timespec *t)
+{
+    return (long long)t->tv_sec * 1000LL + t->tv_nsec / 1000000L;
+}
+
+// Sample the sensor and stepper and publish them to door_udp, which sends
+// an EVENT for anything that changed.
+static void sample_door_state(void)
+{
+    long long distance = door_distance();
+    if (distance == -1) {
+        // sensor error: keep the last published state
+        return;
+    }
+    // Map to UDP booleans:
+    // D0 = door open/close (from ultrasonic), D1 = lock state (from stepper)
+    bool d0_open = (distance >= DOOR_CLOSED_THRESHOLD_CM);      // Door open if distance >= 10cm
+    pthread_mutex_lock(&__publish_lock);
+    if (!__actuator_busy) {
+        bool d1_locked = (StepperMotor_GetPosition() == STEPPER_LOCKED_POSITION); // Lock is locked at 180 degrees
+        door_udp_update(d0_open, false, false, d1_locked);
+    }
+    pthread_mutex_unlock(&__publish_lock);
+}
+
+static Door_t run_door_action(const char *action, Door_t *door)
+{
+    if (strcmp(action, "LOCK") == 0) return lockDoor(door);
+    if (strcmp(action, "UNLOCK") == 0) return unlockDoor(door);
+    return get_door_status(door);
+}
+
+// Queue a job for the actuator worker. Returns false if it is not running
+// or the queue is full.
+static bool actuator_submit(const DoorJob *job)
+{
+    pthread_mutex_lock(&__job_lock);
+    bool ok = __actuator_running && __job_count < DOOR_JOB_QUEUE_SIZE;
+    if (ok) {
+        __jobs[(__job_head + __job_count) % DOOR_JOB_QUEUE_SIZE] = *job;
+        __job_count++;
+        pthread_cond_signal(&__job_cond);
+    }
+    pthread_mutex_unlock(&__job_lock);
+    return ok;
+}
+
+static void *actuator_worker(void *arg)
 {
     (void)arg;
-    fprintf(stderr, "[heartbeat_worker] HAL heartbeat thread started - periodically calling door_udp_update()\n");
-    // This thread calls door_udp_update() periodically to trigger
-    // the HAL's heartbeat mechanism. The HAL handles the actual
-    // HEARTBEAT packet sending via door_udp.c when conditions are met.
-    
-    while (__heartbeat_running) {
-        sleepForMs(__heartbeat_interval_ms);
-        
-        // Read current hardware state directly (don't rely on stale cached state)
-        long long distance = get_distance();
-        uint16_t stepper_pos = StepperMotor_GetPosition();
-        
-        // Map to UDP booleans:
-        // D0 = door open/close (from ultrasonic), D1 = lock state (from stepper)
-        bool d0_open = (distance >= DOOR_CLOSED_THRESHOLD_CM);      // Door open if distance >= 10cm
-        bool d0_locked = false;               // unused
-        bool d1_open = false;                 // unused
-        bool d1_locked = (stepper_pos == STEPPER_LOCKED_POSITION); // Lock is locked at 180 degrees
-        
-        // Call HAL's update function to send heartbeat/notifications
-        door_udp_update(d0_open, d0_locked, d1_open, d1_locked);
+    while (1) {
+        pthread_mutex_lock(&__job_lock);
+        while (__job_count == 0 && __actuator_running) {
+            pthread_cond_wait(&__job_cond, &__job_lock);
+        }
+        if (__job_count == 0) {
+            pthread_mutex_unlock(&__job_lock);
+            break;
+        }
+        DoorJob job = __jobs[__job_head];
+        __job_head = (__job_head + 1) % DOOR_JOB_QUEUE_SIZE;
+        __job_count--;
+        pthread_mutex_unlock(&__job_lock);
+
+        pthread_mutex_lock(&__publish_lock);
+        __actuator_busy = true;
+        pthread_mutex_unlock(&__publish_lock);
+        if (job.kind == DOOR_JOB_REMOTE) {
+            app_run_command(job.module, job.cmdid, job.target, job.action);
+        } else {
+            Door_t d = job.result->door;
+            d = run_door_action(job.action, &d);
+            pthread_mutex_lock(&__job_lock);
+            job.result->door = d;
+            job.result->ran = true;
+            job.result->done = true;
+            pthread_cond_broadcast(&__job_done_cond);
+            pthread_mutex_unlock(&__job_lock);
+        }
+        pthread_mutex_lock(&__publish_lock);
+        __actuator_busy = false;
+        pthread_mutex_unlock(&__publish_lock);
+    }
+    return NULL;
+}
+
+static bool is_lock_action(const char *action)
+{
+    return strcmp(action, "LOCK") == 0 || strcmp(action, "UNLOCK") == 0;
+}
+
+bool door_submit_command(const char *module, int cmdid, const char *target, const char *action)
+{
+    DoorJob job = { .kind = DOOR_JOB_REMOTE, .cmdid = cmdid };
+    snprintf(job.module, sizeof(job.module), "%s", module);
+    snprintf(job.target, sizeof(job.target), "%s", target);
+    snprintf(job.action, sizeof(job.action), "%s", action);
+
+    // Only the newest LOCK or UNLOCK for a target decides where the bolt
+    // ends up, so one still waiting in the queue is dropped (and answered
+    // as superseded) when another arrives. The one already running is
+    // left to finish.
+    DoorJob superseded[DOOR_JOB_QUEUE_SIZE];
+    int n_superseded = 0;
+    if (is_lock_action(job.action)) {
+        pthread_mutex_lock(&__job_lock);
+        int kept = 0;
+        for (int i = 0; i < __job_count; i++) {
+            DoorJob *q = &__jobs[(__job_head + i) % DOOR_JOB_QUEUE_SIZE];
+            if (q->kind == DOOR_JOB_REMOTE && is_lock_action(q->action) &&
+                strcmp(q->target, job.target) == 0) {
+                superseded[n_superseded++] = *q;
+            } else {
+                __jobs[(__job_head + kept) % DOOR_JOB_QUEUE_SIZE] = *q;
+                kept++;
+            }
+        }
+        __job_count = kept;
+        pthread_mutex_unlock(&__job_lock);
+    }
+    for (int i = 0; i < n_superseded; i++) {
+        app_command_superseded(superseded[i].module, superseded[i].cmdid,
+                               superseded[i].target, superseded[i].action);
+    }
+    return actuator_submit(&job);
+}
+
+Door_t door_local_command(const char *action, Door_t *door)
+{
+    DoorLocalResult result = { .door = *door };
+    DoorJob job = { .kind = DOOR_JOB_LOCAL, .result = &result };
+    snprintf(job.action, sizeof(job.action), "%s", action);
+
+    pthread_mutex_lock(&__job_lock);
+    bool running = __actuator_running;
+    pthread_mutex_unlock(&__job_lock);
+    if (!running || !is_lock_action(action)) {
+        // No runtime, so nothing else drives the motor, or a STATUS that
+        // only reads: run it here.
+        *door = run_door_action(action, door);
+        return *door;
+    }
+    if (!actuator_submit(&job)) {
+        printf("Door module busy, %s not run.\n", action);
+        return *door;
+    }
+    pthread_mutex_lock(&__job_lock);
+    while (!result.done) pthread_cond_wait(&__job_done_cond, &__job_lock);
+    pthread_mutex_unlock(&__job_lock);
+    if (!result.ran) printf("Door module stopping, %s not run.\n", action);
+    *door = result.door;
+    return *door;
+}
+
+// The heartbeat timerfd is armed for one absolute deadline at a time on
+// CLOCK_MONOTONIC, each the previous one plus the current period, so
+// neither sensor reads nor a late wake-up shift the heartbeats that follow.
+// The heartbeat carries the state door_udp already holds. The hub counts
+// any packet as a sign of life, so the heartbeat is skipped when an EVENT
+// or FEEDBACK went out in the last half period before its deadline. The
+// period is the configured interval after a state change and doubles
+// while the state is stable, up to a third of the hub's liveness budget
+// (from its HELLO reply). The longest silence is then two and a half
+// periods when one heartbeat is lost, skipped or not, which is within
+// the budget. Without a budget it stays at the configured interval. If the reactor
+// wakes more than a period late, the deadlines that passed are counted
+// as missed.
+static void on_heartbeat_timer(void)
+{
+    uint64_t expirations;
+    if (read(__hb_timerfd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long jitter_us = timespec_diff_us(&now, &__hb_deadline);
+    int period_ms = atomic_load(&__hb_period_ms);
+
+    if (door_udp_last_notification_ms() > timespec_ms(&__hb_deadline) - period_ms / 2) {
+        atomic_fetch_add(&__hb_piggybacked, 1);
+    } else if (door_udp_heartbeat()) {
+        atomic_fetch_add(&__hb_sent, 1);
+        atomic_store(&__hb_last_jitter_us, jitter_us);
+        atomic_fetch_add(&__hb_total_jitter_us, jitter_us);
+        if (jitter_us > atomic_load(&__hb_max_jitter_us)) {
+            atomic_store(&__hb_max_jitter_us, jitter_us);
+        }
+    }
+
+    int budget_ms = door_udp_liveness_budget_ms();
+    int max_ms = budget_ms > 0 ? budget_ms / 3 : __heartbeat_interval_ms;
+    int min_ms = __heartbeat_interval_ms < max_ms ? __heartbeat_interval_ms : max_ms;
+    if (door_udp_last_change_ms() > __hb_prev_deadline_ms) {
+        period_ms = min_ms;
+    } else {
+        period_ms = period_ms * 2 < max_ms ? period_ms * 2 : max_ms;
+    }
+    if (period_ms < min_ms) period_ms = min_ms;
+    atomic_store(&__hb_period_ms, period_ms);
+
+    __hb_prev_deadline_ms = timespec_ms(&__hb_deadline);
+    timespec_add_ms(&__hb_deadline, period_ms);
+    while (timespec_diff_us(&now, &__hb_deadline) >= 0) {
+        timespec_add_ms(&__hb_deadline, period_ms);
+        atomic_fetch_add(&__hb_missed, 1);
+    }
+    arm_timer(__hb_timerfd, &__hb_deadline, 0);
+}
+
+// The sampling timer keeps the configured interval, half a period out of
+// phase with the first heartbeat, however far the heartbeat period has
+// stretched: a change is still seen, and sent as an EVENT, within one
+// interval.
+static void on_sample_timer(void)
+{
+    uint64_t expirations;
+    if (read(__sample_timerfd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return;
+    }
+    sample_door_state();
+}
+
+static void *module_reactor(void *arg)
+{
+    (void)arg;
+    fprintf(stderr, "[module_reactor] started (heartbeat every %d ms)\n", __heartbeat_interval_ms);
+    int sock = door_udp_fd();
+    int resend = door_udp_timer_fd();
+    struct epoll_event evs[5];
+    while (1) {
+        int n = epoll_wait(__epfd, evs, 5, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("[module_reactor] epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            int fd = evs[i].data.fd;
+            if (fd == __wakefd) {
+                return NULL;
+            } else if (fd == sock) {
+                door_udp_poll();
+            } else if (fd == resend) {
+                door_udp_service();
+            } else if (fd == __hb_timerfd) {
+                on_heartbeat_timer();
+            } else if (fd == __sample_timerfd) {
+                on_sample_timer();
+            }
+        }
     }
-    
     return NULL;
 }
 
+static bool watch_fd(int fd)
+{
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+    return epoll_ctl(__epfd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+// Arm `fd` to fire at `first`, then every interval_ms (0: once).
+static bool arm_timer(int fd, const struct timespec *first, int interval_ms)
+{
+    struct itimerspec its = { .it_value = *first };
+    its.it_interval.tv_sec = interval_ms / 1000;
+    its.it_interval.tv_nsec = (long)(interval_ms % 1000) * 1000000L;
+    return timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, NULL) == 0;
+}
+
+static void close_runtime_fds(void)
+{
+    int *fds[] = { &__epfd, &__wakefd, &__hb_timerfd, &__sample_timerfd };
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (*fds[i] >= 0) close(*fds[i]);
+        *fds[i] = -1;
+    }
+}
+
+static bool runtime_open(void)
+{
+    __epfd = epoll_create1(EPOLL_CLOEXEC);
+    __wakefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    __hb_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    __sample_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (__epfd < 0 || __wakefd < 0 || __hb_timerfd < 0 || __sample_timerfd < 0) {
+        perror("[door_reporting_start] runtime descriptors");
+        return false;
+    }
+
+    struct timespec start, sample;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    __hb_deadline = start;
+    __hb_prev_deadline_ms = timespec_ms(&start);
+    timespec_add_ms(&__hb_deadline, __heartbeat_interval_ms);
+    sample = start;
+    timespec_add_ms(&sample, __heartbeat_interval_ms / 2);
+    if (!arm_timer(__hb_timerfd, &__hb_deadline, 0) ||
+        !arm_timer(__sample_timerfd, &sample, __heartbeat_interval_ms)) {
+        perror("[door_reporting_start] timerfd_settime");
+        return false;
+    }
+
+    // Without a socket (door_udp_init2 failed) the module still samples.
+    if ((door_udp_fd() >= 0 && !watch_fd(door_udp_fd())) ||
+        (door_udp_timer_fd() >= 0 && !watch_fd(door_udp_timer_fd())) ||
+        !watch_fd(__wakefd) || !watch_fd(__hb_timerfd) || !watch_fd(__sample_timerfd)) {
+        perror("[door_reporting_start] epoll_ctl");
+        return false;
+    }
+    return true;
+}
+
+// Only the job already running finishes, so a door in motion completes
+// its move. Queued hub commands are answered as aborted and queued local
+// ones are handed back unrun.
+static void actuator_stop(void)
+{
+    DoorJob dropped[DOOR_JOB_QUEUE_SIZE];
+    int n_dropped = 0;
+
+    pthread_mutex_lock(&__job_lock);
+    bool running = __actuator_running;
+    __actuator_running = false;
+    for (int i = 0; i < __job_count; i++) {
+        DoorJob *q = &__jobs[(__job_head + i) % DOOR_JOB_QUEUE_SIZE];
+        if (q->kind == DOOR_JOB_LOCAL) {
+            q->result->done = true;
+        } else {
+            dropped[n_dropped++] = *q;
+        }
+    }
+    __job_count = 0;
+    pthread_cond_broadcast(&__job_done_cond);
+    pthread_cond_signal(&__job_cond);
+    pthread_mutex_unlock(&__job_lock);
+
+    for (int i = 0; i < n_dropped; i++) {
+        app_command_aborted(dropped[i].module, dropped[i].cmdid,
+                            dropped[i].target, dropped[i].action);
+    }
+    if (running) pthread_join(__actuator_thread, NULL);
+}
+
+void door_heartbeat_stats(DoorHeartbeatStats *out)
+{
+    if (!out) return;
+    out->interval_ms = __heartbeat_interval_ms;
+    out->sent = atomic_load(&__hb_sent);
+    out->missed = atomic_load(&__hb_missed);
+    out->piggybacked = atomic_load(&__hb_piggybacked);
+    out->period_ms = atomic_load(&__hb_period_ms);
+    out->last_jitter_us = atomic_load(&__hb_last_jitter_us);
+    out->max_jitter_us = atomic_load(&__hb_max_jitter_us);
+    out->mean_jitter_us = out->sent ? atomic_load(&__hb_total_jitter_us) / (long long)out->sent : 0;
+}
+
 bool door_reporting_start(const char *hub_ip, uint16_t report_port, uint16_t heartbeat_port,
                           const char *module_id, int heartbeat_ms)
 {
@@ -136,10 +702,31 @@ bool door_reporting_start(const char *hub_ip, uint16_t report_port, uint16_t hea
     __heartbeat_port = heartbeat_port;
     __heartbeat_interval_ms = (heartbeat_ms > 0) ? heartbeat_ms : 1000;
     __report_module_id = strdup(module_id);
+    atomic_store(&__hb_sent, 0);
+    atomic_store(&__hb_missed, 0);
+    atomic_store(&__hb_piggybacked, 0);
+    atomic_store(&__hb_period_ms, __heartbeat_interval_ms);
+    atomic_store(&__hb_last_jitter_us, 0);
+    atomic_store(&__hb_max_jitter_us, 0);
+    atomic_store(&__hb_total_jitter_us, 0);
+
+    __job_head = __job_count = 0;
+    __actuator_running = true;
+    if (pthread_create(&__actuator_thread, NULL, actuator_worker, NULL) != 0) {
+        __actuator_running = false;
+        free(__report_module_id);
+        __report_module_id = NULL;
+        return false;
+    }
+    // The first sample publishes the state and sends the first heartbeat.
+    sample_door_state();
 
     __heartbeat_running = 1;
-    if (pthread_create(&__heartbeat_thread, NULL, heartbeat_worker, NULL) != 0) {
+    if (!runtime_open() ||
+        pthread_create(&__reactor_thread, NULL, module_reactor, NULL) != 0) {
         __heartbeat_running = 0;
+        actuator_stop();
+        close_runtime_fds();
         free(__report_module_id);
         __report_module_id = NULL;
         return false;
@@ -155,10 +742,26 @@ bool door_reporting_start(const char *hub_ip, uint16_t report_port, uint16_t hea
 
 void door_reporting_stop(void)
 {
-    // stop heartbeat
+    if (!__heartbeat_running) return;
     __heartbeat_running = 0;
-    pthread_join(__heartbeat_thread, NULL);
-    
+
+    // stop the reactor: it returns as soon as it sees the eventfd
+    uint64_t one = 1;
+    ssize_t n = write(__wakefd, &one, sizeof(one));
+    (void)n;
+    pthread_join(__reactor_thread, NULL);
+    actuator_stop();
+    close_runtime_fds();
+
+    DoorHeartbeatStats st;
+    door_heartbeat_stats(&st);
+    fprintf(stderr, "[door_reporting_stop] %lu heartbeats, %lu covered by events, %lu missed, jitter mean %lld us max %lld us\n",
+            st.sent, st.piggybacked, st.missed, st.mean_jitter_us, st.max_jitter_us);
+    DoorEventStats ev;
+    door_udp_event_stats(&ev);
+    fprintf(stderr, "[door_reporting_stop] %lu events, %lu acked, %lu resent, %lu superseded, %lu expired, %d unacked\n",
+            ev.sent, ev.acked, ev.retransmits, ev.superseded, ev.expired, ev.unacked);
+
     if (__report_module_id) {
         free(__report_module_id);
         __report_module_id = NULL;
@@ -167,7 +770,6 @@ void door_reporting_stop(void)
     door_udp_close();
 }
 
-
 // Initialize the door system
 bool initializeDoorSystem (){
     if (!init_hc_sr04 () || !StepperMotor_Init () ) {
@@ -180,29 +782,21 @@ bool initializeDoorSystem (){
         fprintf(stderr, "Warning: LED_init failed (continuing)\n");
     }
 
+    // Keep a filtered distance estimate so nothing else waits on the sensor
+    if (!sensor_start()) {
+        fprintf(stderr, "Warning: sensor sampler failed to start (reading on demand)\n");
+    }
+
     // Register app UDP command handler so the HAL transport forwards COMMANDs here
     app_udp_handler_init();
 
     return true;
 }
 
+// The sampler already filters the distance; this used to average 100 ms
+// of fresh readings before every lock.
 long long avgDistanceSample (void){
-    long long totalDistance = 0;
-    int sample_count = 0;
-    long long start_sampling_time = getTimeInMs();
-    while ((getTimeInMs() - start_sampling_time) < 100){
-        long long distance = get_distance();
-        if (distance != -1){
-            totalDistance += distance;
-            sample_count++;
-        }
-        sleepForMs(5); // Small delay between samples
-    }
-    if (sample_count == 0){
-        return -1; // Indicate error if no valid samples
-    }
-
-    return totalDistance / sample_count;
+    return door_distance();
 }
 
 
@@ -248,7 +842,7 @@ Door_t unlockDoor (Door_t *door){
     if (StepperMotor_GetPosition() == 0){
         printf("Door is already unlocked.\n");
     } else {
-        long long distance = get_distance();
+        long long distance = door_distance();
 
         /* If our last-known state indicates the door was previously locked
            (for example from a recent heartbeat or event), allow unlocking
@@ -299,7 +893,7 @@ Door_t unlockDoor (Door_t *door){
 
 // Get the current status of the door
 Door_t get_door_status (Door_t *door){
-    long long distance = get_distance();
+    long long distance = door_distance();
     if (StepperMotor_GetPosition() == STEPPER_LOCKED_POSITION){
         door->state = LOCKED;
         printf("Door is LOCKED.\n");
@@ -336,6 +930,7 @@ void doorMod_cleanup(void){
     }
     // Stop reporting
     door_reporting_stop();
+    sensor_stop();
 
     // Shutdown LED worker
     LED_worker_shutdown();
@@ -81,7 +81,7 @@ int main(int argc, char *argv[])
     Door_t door = { .state = UNKNOWN };
 
     // ---- CLI loop ----
-    printf("doorMod CLI started. Commands: l(lock), u(unlock), s(status), q(quit)\n");
+    printf("doorMod CLI started. Commands: l(lock), u(unlock), s(status), h(heartbeat and sensor stats), q(quit)\n");
     fflush(stdout);
 
     char line[128];
@@ -147,7 +147,7 @@ int main(int argc, char *argv[])
             printf("DEBUG: calling lockDoor()\n");
             fflush(stdout);
 #endif
-            door = lockDoor(&door);
+            door = door_local_command("LOCK", &door);
 #ifdef DEBUG
             printf("DEBUG: returned from lockDoor(), state=%d\n", door.state);
             fflush(stdout);
@@ -160,7 +160,7 @@ int main(int argc, char *argv[])
             printf("DEBUG: calling unlockDoor()\n");
             fflush(stdout);
 #endif
-            door = unlockDoor(&door);
+            door = door_local_command("UNLOCK", &door);
 #ifdef DEBUG
             printf("DEBUG: returned from unlockDoor(), state=%d\n", door.state);
             fflush(stdout);
@@ -173,7 +173,7 @@ int main(int argc, char *argv[])
             printf("DEBUG: calling get_door_status()\n");
             fflush(stdout);
 #endif
-            door = get_door_status(&door);
+            door = door_local_command("STATUS", &door);
 #ifdef DEBUG
             printf("DEBUG: returned from get_door_status(), state=%d\n", door.state);
             fflush(stdout);
@@ -181,10 +181,31 @@ int main(int argc, char *argv[])
             continue;
         }
 
+        if (c == 'h') {
+            DoorHeartbeatStats hb;
+            door_heartbeat_stats(&hb);
+            printf("heartbeat every %d ms (base %d ms): %lu sent, %lu covered by events, %lu missed, "
+                   "jitter last %lld us, mean %lld us, max %lld us\n",
+                   hb.period_ms, hb.interval_ms, hb.sent, hb.piggybacked, hb.missed,
+                   hb.last_jitter_us, hb.mean_jitter_us, hb.max_jitter_us);
+            DoorEventStats ev;
+            door_udp_event_stats(&ev);
+            printf("events: %lu sent, %lu acked, %lu resent, %lu superseded, %lu expired, %d unacked, rto %d ms\n",
+                   ev.sent, ev.acked, ev.retransmits, ev.superseded, ev.expired,
+                   ev.unacked, ev.rto_ms);
+            DoorSensorEstimate se;
+            bool fresh = door_sensor_estimate(&se);
+            printf("sensor: %lld cm, %lld ms old%s, %lu readings, %lu errors\n",
+                   se.distance_cm, se.age_ms, fresh ? "" : " (stale)",
+                   se.samples, se.errors);
+            fflush(stdout);
+            continue;
+        }
+
         // Full-word commands (case-insensitive)
-        if (strncasecmp(p, "lock",   4) == 0) { door = lockDoor(&door);        continue; }
-        if (strncasecmp(p, "unlock", 6) == 0) { door = unlockDoor(&door);      continue; }
-        if (strncasecmp(p, "status", 6) == 0) { door = get_door_status(&door); continue; }
+        if (strncasecmp(p, "lock",   4) == 0) { door = door_local_command("LOCK", &door);   continue; }
+        if (strncasecmp(p, "unlock", 6) == 0) { door = door_local_command("UNLOCK", &door); continue; }
+        if (strncasecmp(p, "status", 6) == 0) { door = door_local_command("STATUS", &door); continue; }
 
         printf("Unknown command: '%s'\n", p);
         fflush(stdout);
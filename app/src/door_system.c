@@ -4,6 +4,7 @@
 #include <time.h>
 #include <string.h>
 #include "hal/hub_udp.h"
+#include "hal/hub_bus.h"
 #include "hal/led.h"
 #include "hal/led_worker.h"
 #include "hal/door_udp.h"
@@ -79,13 +80,15 @@ int main(int argc, char *argv[]){
         return 1;
     }
     
-    /* Bind Discord webhook traffic to wlan0 interface */
-    discord_set_device("wlan0");
-    
-    hub_udp_set_webhook_url("https://discord.com/api/webhooks/1445277245743697940/-DWPsZbIoDTyo1iaXRW3Vo4URqJ1RpkjGQ4ijXENNeYcM9bNHUj90aunxeSU5GsnoZ_M");
+    /* Bind Discord webhook traffic to wlan0 interface (HUB_WEBHOOK_DEVICE
+     * overrides it; set it empty to use any interface) */
+    const char *webhook_device = getenv("HUB_WEBHOOK_DEVICE");
+    discord_set_device(webhook_device ? webhook_device : "wlan0");
 
         // Start webhook reporter if provided via argv[3] or environment
         const char *webhook_url = (argc > 3) ? argv[3] : getenv("HUB_WEBHOOK_URL");
+
+    hub_udp_set_webhook_url(webhook_url ? webhook_url : "https://discord.com/api/webhooks/1445277245743697940/-DWPsZbIoDTyo1iaXRW3Vo4URqJ1RpkjGQ4ijXENNeYcM9bNHUj90aunxeSU5GsnoZ_M");
         bool webhook_running = false;
         char *discord_provider_ctx = NULL;
         if (webhook_url) {
@@ -104,7 +107,7 @@ int main(int argc, char *argv[]){
             if (discordStart()) {
                 discord_provider_ctx = strdup(module_id);
                 if (discord_provider_ctx) {
-                    if (!startDoorAlertMonitor(door_alert_provider, discord_provider_ctx, webhook_url)) {
+                    if (!startDoorAlertMonitor(module_id, door_alert_provider, discord_provider_ctx, webhook_url)) {
                         free(discord_provider_ctx);
                         discord_provider_ctx = NULL;
                     }
@@ -174,11 +177,41 @@ int main(int argc, char *argv[]){
             }
         }
 
+        if (cmd[0] == 'w') {
+            DiscordStats ds;
+            discord_get_stats(&ds);
+            printf("Webhook: sent=%lld failed=%lld new_conns=%lld last=%lldus max=%lldus avg=%lldus\n",
+                   ds.sent, ds.failed, ds.new_connections, ds.last_us, ds.max_us,
+                   ds.sent > 0 ? ds.total_us / ds.sent : 0);
+            HubWebhookStats ws;
+            hub_webhook_get_stats(&ws);
+            printf("Webhook queue: depth=%d (in memory %d) oldest=%lldms delivered=%lld retries=%lld dropped=%lld\n",
+                   ws.depth, ws.mem_depth, ws.oldest_age_ms,
+                   ws.delivered, ws.retries, ws.dropped);
+        }
+
+        if (cmd[0] == 'e') {
+            HubBusStats bs;
+            hub_bus_get_stats(&bs);
+            printf("Bus published:");
+            for (int i = 0; i < HUB_EV_TYPE_COUNT; i++) {
+                printf(" %s=%llu", hub_bus_type_name((HubEventType)(1u << i)),
+                       (unsigned long long)bs.published[i]);
+            }
+            printf("\n");
+            for (int i = 0; i < bs.num_subs; i++) {
+                printf("  subscriber %-14s depth=%d/%d dropped=%llu\n",
+                       bs.subs[i].name, bs.subs[i].depth, bs.subs[i].capacity,
+                       (unsigned long long)bs.subs[i].dropped);
+            }
+        }
+
         if (cmd[0] == 'h') {
             HubEvent events[20];
             int n = hub_udp_get_history(events, 20);
             for (int i = 0; i < n; i++) {
-                printf("[%lld] %s: %s\n",
+                printf("#%llu [%lld] %s: %s\n",
+                       (unsigned long long)events[i].seq,
                        events[i].timestamp_ms,
                        events[i].module_id,
                        events[i].line);
@@ -193,6 +226,11 @@ int main(int argc, char *argv[]){
         }
     }
 
+    if (discord_provider_ctx) {
+        stopDoorAlertMonitor();
+        free(discord_provider_ctx);
+        discord_provider_ctx = NULL;
+    }
     hub_udp_shutdown();
 
     if (door_udp_running) {
@@ -1,14 +1,117 @@
 // app/src/door_udp_handler.c
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
+#include <time.h>
 #include "hal/door_udp.h"
 #include "doorMod.h"
 
-static void app_command_handler(const char *module, int cmdid,
-                                const char *target, const char *action,
-                                void *ctx)
+extern bool door_submit_command(const char *module, int cmdid, const char *target, const char *action);
+
+// ---------- recently executed commands ----------
+// The hub resends a COMMAND it has no FEEDBACK for after 500 ms, which a
+// lock or unlock easily outlasts. Commands are remembered by (cmdid,
+// target, action); the hub numbers every command it sends, its own and
+// the ones it relays, from one counter. A duplicate of a finished command
+// is answered from its cached result; one of a queued or running command
+// only gets ACCEPTED again, since that execution's FEEDBACK answers both.
+// Entries expire after CMD_CACHE_TTL_MS, so a restarted hub reusing
+// cmdids runs them again; when all slots are taken the least recently
+// used finished one goes.
+#define CMD_CACHE_SIZE   32
+#define CMD_CACHE_TTL_MS 10000
+
+typedef struct {
+    bool      used;
+    bool      done;         // result[] holds the FEEDBACK action
+    int       cmdid;
+    char      target[16];
+    char      action[16];
+    char      result[32];
+    long long used_ms;      // last lookup or insert
+} CmdCacheEntry;
+
+static CmdCacheEntry   g_cmd_cache[CMD_CACHE_SIZE];
+static pthread_mutex_t g_cmd_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static long long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000LL + ts.tv_nsec / 1000000LL;
+}
+
+// Call with g_cmd_cache_lock held.
+static CmdCacheEntry *cmd_cache_find(int cmdid, const char *target,
+                                     const char *action, long long now)
+{
+    for (int i = 0; i < CMD_CACHE_SIZE; i++) {
+        CmdCacheEntry *e = &g_cmd_cache[i];
+        if (!e->used) continue;
+        if (e->done && now - e->used_ms > CMD_CACHE_TTL_MS) {
+            e->used = false;
+            continue;
+        }
+        if (e->cmdid == cmdid && strcmp(e->target, target) == 0 &&
+            strcmp(e->action, action) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+// Claim a slot: a free one, else the least recently used finished one.
+// Call with g_cmd_cache_lock held.
+static CmdCacheEntry *cmd_cache_insert(int cmdid, const char *target,
+                                       const char *action, long long now)
+{
+    CmdCacheEntry *slot = NULL;
+    for (int i = 0; i < CMD_CACHE_SIZE; i++) {
+        CmdCacheEntry *e = &g_cmd_cache[i];
+        if (!e->used) { slot = e; break; }
+        if (e->done && (!slot || e->used_ms < slot->used_ms)) slot = e;
+    }
+    if (!slot) return NULL;     // every slot is still executing
+    memset(slot, 0, sizeof(*slot));
+    slot->used = true;
+    slot->cmdid = cmdid;
+    snprintf(slot->target, sizeof(slot->target), "%s", target);
+    snprintf(slot->action, sizeof(slot->action), "%s", action);
+    slot->used_ms = now;
+    return slot;
+}
+
+static void cmd_cache_finish(int cmdid, const char *target,
+                             const char *action, const char *result)
+{
+    pthread_mutex_lock(&g_cmd_cache_lock);
+    long long now = now_ms();
+    CmdCacheEntry *e = cmd_cache_find(cmdid, target, action, now);
+    if (e) {
+        snprintf(e->result, sizeof(e->result), "%s", result);
+        e->done = true;
+        e->used_ms = now;
+    }
+    pthread_mutex_unlock(&g_cmd_cache_lock);
+}
+
+static void cmd_cache_forget(int cmdid, const char *target, const char *action)
+{
+    pthread_mutex_lock(&g_cmd_cache_lock);
+    CmdCacheEntry *e = cmd_cache_find(cmdid, target, action, now_ms());
+    if (e) e->used = false;
+    pthread_mutex_unlock(&g_cmd_cache_lock);
+}
+
+// ---------- command execution ----------
+
+// Run a COMMAND from the hub and answer it with FEEDBACK. A LOCK or UNLOCK
+// blocks for the whole stepper move, so those run on the door module's
+// actuator worker; STATUS only reads the sensor estimate and the stepper
+// position and runs on the reactor.
+void app_run_command(const char *module, int cmdid,
+                     const char *target, const char *action)
 {
-    (void)ctx;
     Door_t d = { .state = UNKNOWN };
 
     const char *out_action = action;
@@ -38,6 +141,9 @@ static void app_command_handler(const char *module, int cmdid,
         out_action = action_buf;
     }
 
+    cmd_cache_finish(cmdid, target ? target : "", action ? action : "",
+                     out_action ? out_action : "");
+
     // Send FEEDBACK via HAL transport
     door_udp_send_feedback(module,
                            cmdid,
@@ -45,6 +151,90 @@ static void app_command_handler(const char *module, int cmdid,
                            out_action ? out_action : "");
 }
 
+// Answer a queued command that will not run as <ACTION>_<why>.
+static void answer_unrun(const char *module, int cmdid, const char *target,
+                         const char *action, const char *why)
+{
+    char result[32];
+    snprintf(result, sizeof(result), "%s_%s", action, why);
+    cmd_cache_finish(cmdid, target, action, result);
+    door_udp_send_feedback(module, cmdid, target, result);
+}
+
+// A queued LOCK/UNLOCK dropped for a newer one on the same target: answer
+// it as <ACTION>_SUPERSEDED without running it.
+void app_command_superseded(const char *module, int cmdid,
+                            const char *target, const char *action)
+{
+    fprintf(stderr, "[app_command_superseded] command %d %s replaced before it ran\n",
+            cmdid, action);
+    answer_unrun(module, cmdid, target, action, "SUPERSEDED");
+}
+
+// A queued command dropped because the module is stopping: answer it as
+// <ACTION>_ABORTED so the hub fails it now instead of timing out.
+void app_command_aborted(const char *module, int cmdid,
+                         const char *target, const char *action)
+{
+    fprintf(stderr, "[app_command_aborted] command %d %s dropped at shutdown\n",
+            cmdid, action);
+    answer_unrun(module, cmdid, target, action, "ABORTED");
+}
+
+// Called on the module reactor: answer a duplicate from the cache, answer
+// STATUS at once, or hand a LOCK/UNLOCK to the actuator worker so the
+// reactor keeps serving heartbeats while the door moves. A command the
+// worker takes is acked as ACCEPTED at once; its FEEDBACK follows when it
+// has run.
+static void app_command_handler(const char *module, int cmdid,
+                                const char *target, const char *action,
+                                void *ctx)
+{
+    (void)ctx;
+    char result[32];
+    bool cached = false;
+
+    pthread_mutex_lock(&g_cmd_cache_lock);
+    long long now = now_ms();
+    CmdCacheEntry *e = cmd_cache_find(cmdid, target, action, now);
+    if (e) {
+        e->used_ms = now;
+        cached = e->done;
+        if (cached) snprintf(result, sizeof(result), "%s", e->result);
+    } else if (!cmd_cache_insert(cmdid, target, action, now)) {
+        fprintf(stderr, "[app_command_handler] command cache full\n");
+    }
+    pthread_mutex_unlock(&g_cmd_cache_lock);
+
+    if (e) {
+        if (cached) {
+            fprintf(stderr, "[app_command_handler] duplicate command %d %s: answered from cache\n",
+                    cmdid, action);
+            door_udp_send_feedback(module, cmdid, target, result);
+        } else {
+            // The hub missed our ACCEPTED or is checking on a long run.
+            fprintf(stderr, "[app_command_handler] duplicate command %d %s: already in progress\n",
+                    cmdid, action);
+            door_udp_send_accepted(module, cmdid, target, action);
+        }
+        return;
+    }
+
+    // Not queued behind moves in progress: the FEEDBACK is the answer.
+    if (strcmp(action, "STATUS") == 0) {
+        app_run_command(module, cmdid, target, action);
+        return;
+    }
+
+    if (!door_submit_command(module, cmdid, target, action)) {
+        fprintf(stderr, "[app_command_handler] actuator queue full, dropping command %d %s\n",
+                cmdid, action);
+        cmd_cache_forget(cmdid, target, action);
+        return;
+    }
+    door_udp_send_accepted(module, cmdid, target, action);
+}
+
 bool app_udp_handler_init(void)
 {
     return door_udp_register_command_handler(app_command_handler, NULL);
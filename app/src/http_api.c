@@ -2,294 +2,2999 @@
 #include "http_api.h"
 #include "doorMod.h"
 #include "hal/hub_udp.h"
+#include "hal/hub_bus.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <dirent.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <strings.h>
+#include <time.h>
+#include <limits.h>
+
+// Event-driven front end: one reactor thread owns the listening socket and
+// every connection (non-blocking, epoll). Requests that touch local
+// hardware run on a small worker pool; remote commands are submitted
+// without blocking and the connection is parked until the matching
+// HUB_EV_COMMAND_RESULT arrives on the hub bus.
+//
+// Connections are HTTP/1.1 persistent: requests are framed by
+// Content-Length and answered strictly in order, so a client may pipeline
+// several requests; the next buffered one is dispatched as soon as the
+// previous response has been written.
+//
+// GET /api/events turns a connection into a Server-Sent Events stream. Each
+// stream keeps a cursor into the hub history (whose seq is the SSE event
+// id) and is refilled from it whenever the hub bus signals; a client that
+// reads slowly simply falls behind on its own cursor.
+//
+// GET /api/ws upgrades to a WebSocket (RFC 6455) that carries the same
+// event feed as JSON text frames and also accepts commands, so a browser
+// reaches the hub without the Node UDP bridge. It reuses the stream
+// machinery: output goes through the bounded stream buffer, and incoming
+// frames are parsed from the request buffer.
+//
+// With HTTP_STATIC_DIR set, the files of that directory (the dashboard)
+// are served too: opened once at start and sent with sendfile().
+//
+// Status, history and command results are JSON unless the request sends
+// Accept: application/cbor, in which case the same objects are encoded as
+// CBOR straight into the response buffer (status from its own cache).
+
+#define HTTP_MAX_CONNS        128
+#define HTTP_REQ_MAX          8192
+#define HTTP_MAX_HEADERS      32
+#define HTTP_POOL_KEEP        32     // idle buffers kept per pool
+#define HTTP_WORKERS          4
+#define HTTP_IO_TIMEOUT_MS    5000   // to receive a request / flush a response
+#define HTTP_IDLE_TIMEOUT_MS  5000   // keep-alive: between two requests
+#define HTTP_MAX_REQUESTS     100    // per connection, then close
+#define HTTP_SSE_BUF          16384  // queued bytes per event stream
+#define HTTP_SSE_PING_MS      15000  // comment line on an idle stream
+#define HTTP_SSE_STALL_MS     30000  // drop a stream that stops reading
+#define HTTP_SSE_DEFAULT_TYPES (HUB_EV_DOOR | HUB_EV_LOCK | HUB_EV_HEARTBEAT | \
+                                HUB_EV_FEEDBACK | HUB_EV_ONLINE | HUB_EV_OFFLINE)
+#define HTTP_PARK_TIMEOUT_MS  (HUB_CMD_MAX_MS + 1000)  // safety net past the hub's own deadline
+#define HTTP_CMD_RECORDS      256    // async command outcomes kept (by cmdid)
+#define HTTP_WS_MAX_CMDS      8      // remote commands in flight per WebSocket
+#define HTTP_WS_RESERVE       2048   // stream buffer kept free for command results
+#define HTTP_WS_MAX_MSG       1024   // longest command message accepted
+#define HTTP_HISTORY_DEFAULT  50     // /api/history entries per page
+#define HTTP_BODY_KEEP        16384  // larger response bodies are freed when sent
+#define HTTP_STATUS_JSON_MAX  2048   // one rendered module status
+#define HTTP_STATUS_CBOR_MAX  512    // the same as CBOR
+#define HTTP_BATCH_MAX        16     // commands in one POST /api/commands
+#define HTTP_STATIC_MAX       64     // files served from HTTP_STATIC_DIR
+
+// epoll tags for the non-connection descriptors
+#define TAG_LISTEN  (HTTP_MAX_CONNS + 0)
+#define TAG_WAKE    (HTTP_MAX_CONNS + 1)
+#define TAG_BUS     (HTTP_MAX_CONNS + 2)
+
+typedef enum {
+    CONN_FREE = 0,
+    CONN_READING,   // accumulating the request (reactor)
+    CONN_WORKING,   // owned by a worker thread
+    CONN_PARKED,    // waiting for a command result (reactor)
+    CONN_WRITING,   // flushing the response (reactor)
+    CONN_STREAM     // SSE or WebSocket until the client goes away
+} ConnState;
+
+typedef enum {
+    PARSE_LINE = 0,   // waiting for the request line
+    PARSE_HEADERS,
+    PARSE_BODY        // headers done; waiting for Content-Length bytes
+} ParseState;
+
+// A view into a connection's request buffer; not NUL-terminated.
+typedef struct {
+    const char *p;
+    size_t      len;
+} HttpSlice;
+
+typedef struct {
+    HttpSlice   name;
+    HttpSlice   value;
+} HttpHeader;
+
+typedef enum {
+    JOB_LOCAL_STATUS,
+    JOB_LOCAL_COMMAND,
+    JOB_BATCH_LOCAL     // the hub's own commands of a batch, in order
+} JobKind;
+
+// One command of a POST /api/commands batch.
+typedef struct {
+    char      mod[HUB_MODULE_ID_LEN];
+    char      target[32];
+    char      action[32];
+    char      tag[32];          // client's id, echoed back
+    bool      local;            // runs on a worker, not through the hub
+    bool      done;
+    int       cmdid;            // while pending with the hub
+    long long ms;               // from batch start to result
+    char      fields[256];      // JSON members of the result
+} HttpBatchItem;
+
+typedef struct {
+    int           count;
+    int           pending;      // remote commands without a result yet
+    long long     start_ms;
+    HttpBatchItem items[HTTP_BATCH_MAX];
+} HttpBatch;
+
+typedef struct {
+    int         fd;
+    ConnState   state;
+    long long   deadline_ms;
+
+    uint32_t    events;         // current epoll interest (0 = not watched)
+
+    char       *req;            // buffered request bytes (pooled)
+    size_t      req_len;
+    size_t      req_total;      // length of the request being handled
+    bool        keep_alive;
+    bool        cbor;           // Accept: application/cbor
+    bool        peer_closed;    // EOF seen; answer what is buffered, then close
+    int         served;         // requests dispatched on this connection
+
+    char        mod[HUB_MODULE_ID_LEN];
+    char        target[32];
+    char        action[32];
+    // Incremental parse of the request at the start of `req`. The slices
+    // point into `req` and are valid until the request is finished.
+    ParseState  parse;
+    size_t      scan;           // next byte not yet examined
+    size_t      body_off;
+    size_t      content_length;
+    bool        has_length;
+    HttpSlice   method;
+    HttpSlice   path;           // request target up to '?'
+    HttpSlice   query;          // after '?', empty if none
+    HttpSlice   version;
+    HttpHeader  hdrs[HTTP_MAX_HEADERS];
+    int         num_hdrs;
+    HttpSlice   req_body;
+
+    JobKind     job;
+    int         cmdid;          // while parked
+    HttpBatch  *batch;          // POST /api/commands in progress
+    char        tag[32];        // client's id for a WebSocket command
+
+    char        hdr[512];
+    size_t      hdr_len;
+    char       *body;
+    size_t      body_len;
+    size_t      body_cap;       // body is reused across responses
+    size_t      out_off;        // bytes of hdr + body already sent
+    int         file_fd;        // static file sent after hdr, if file_len > 0
+    size_t      file_off;
+    size_t      file_len;
+
+    // CONN_STREAM
+    char       *sbuf;           // queued stream bytes [sbuf_off, sbuf_len)
+    size_t      sbuf_len;
+    size_t      sbuf_off;
+    uint64_t    cursor;         // last history seq consumed for this client
+    uint32_t    type_mask;      // HubEventType bits to forward
+    int         hb_every_ms;    // heartbeat sampling: 0 = all, < 0 = none
+    char        filter_mod[HUB_MODULE_ID_LEN];
+    struct {
+        char      module_id[HUB_MODULE_ID_LEN];
+        long long last_ms;
+    } hb_sent[HUB_MAX_DOORS];
+    // History export: a finite stream of the entries up to export_end
+    bool        exporting;
+    bool        chunked;        // HTTP/1.1: chunked; 1.0: ends at close
+    bool        export_done;    // everything (and the last chunk) queued
+    uint64_t    export_end;
+
+    // WebSocket: a CONN_STREAM that frames its output and reads commands
+    bool        ws;
+    struct {
+        int     cmdid;          // 0 = free
+        char    mod[HUB_MODULE_ID_LEN];
+        char    tag[32];
+    } ws_cmds[HTTP_WS_MAX_CMDS];
+} HttpConn;
+
+typedef struct {
+    size_t size;
+    int    count;
+    char  *free[HTTP_POOL_KEEP];
+} BufPool;
+
+// A file of HTTP_STATIC_DIR, kept open for sendfile().
+typedef struct {
+    char        name[64];       // request path without the leading '/'
+    const char *type;
+    int         fd;
+    size_t      size;
+    char        etag[48];
+    int         gz_fd;          // pre-compressed <name>.gz, or -1
+    size_t      gz_size;
+    char        gz_etag[48];
+} StaticFile;
+
+typedef struct {
+    char     module_id[HUB_MODULE_ID_LEN];
+    uint64_t version;           // HubDoorStatus.version rendered (0 = free)
+    size_t   len;
+    char     json[HTTP_STATUS_JSON_MAX];
+    size_t   cbor_len;
+    uint8_t  cbor[HTTP_STATUS_CBOR_MAX];
+} StatusCacheEntry;
 
 static int server_sock = -1;
 static volatile int server_running = 0;
 static pthread_t server_thread;
 static char g_module_id[32] = {0};
+static long long g_etag_epoch = 0;   // keeps ETags unique across restarts
+static char     *g_api_token = NULL; // HTTP_API_TOKEN, read once at start
+static size_t    g_api_token_len = 0;
+static StaticFile g_static[HTTP_STATIC_MAX];   // loaded at start, then read-only
+static int        g_static_count = 0;
+
+static int        g_epfd   = -1;
+static int        g_wakefd = -1;     // worker completions and stop requests
+static HubBusSub *g_results = NULL;  // command results (parked requests) and
+                                     // the wakeup for event streams
+static HttpConn   g_conns[HTTP_MAX_CONNS];
+
+// Request and stream buffers are recycled rather than going back to malloc
+// for every connection. Only the reactor takes and returns them.
+static BufPool    g_req_pool    = { .size = HTTP_REQ_MAX };
+static BufPool    g_stream_pool = { .size = HTTP_SSE_BUF };
+
+// Job queue (reactor -> workers) and done queue (workers -> reactor). Each
+// connection is in at most one queue at a time, so HTTP_MAX_CONNS slots
+// always suffice.
+static pthread_t       g_workers[HTTP_WORKERS];
+static pthread_mutex_t g_q_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  g_q_cond = PTHREAD_COND_INITIALIZER;
+static int             g_jobs[HTTP_MAX_CONNS];
+static int             g_job_head = 0, g_job_count = 0;
+static int             g_done[HTTP_MAX_CONNS];
+static int             g_done_head = 0, g_done_count = 0;
+static bool            g_workers_stop = false;
+
+// Every job calls into doorMod, which drives a single motor, so at most
+// one worker runs a job at a time.
+static pthread_mutex_t g_local_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// ---------- time helper ----------
+
+static long long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000LL + ts.tv_nsec / 1000000LL;
+}
+
+// ---------- buffer pool ----------
+
+static char *pool_get(BufPool *p)
+{
+    return p->count ? p->free[--p->count] : malloc(p->size);
+}
+
+static void pool_put(BufPool *p, char *buf)
+{
+    if (!buf) return;
+    if (p->count < HTTP_POOL_KEEP) {
+        p->free[p->count++] = buf;
+    } else {
+        free(buf);
+    }
+}
+
+static void pool_drain(BufPool *p)
+{
+    while (p->count) free(p->free[--p->count]);
+}
+
+// ---------- responses ----------
+
+static const char *status_text(int status_code)
+{
+    switch (status_code) {
+        case 200: return "OK";
+        case 202: return "Accepted";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 404: return "Not Found";
+        case 411: return "Length Required";
+        case 413: return "Payload Too Large";
+        case 426: return "Upgrade Required";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        case 504: return "Gateway Timeout";
+        default:  return "Error";
+    }
+}
+
+// Make room for a `len`-byte response body in c->body. Returns false if
+// it cannot be allocated.
+static bool body_reserve(HttpConn *c, size_t len)
+{
+    if (len <= c->body_cap) return true;
+    char *grown = realloc(c->body, len);
+    if (!grown) return false;
+    c->body = grown;
+    c->body_cap = len;
+    return true;
+}
+
+// Write the response header for a `length`-byte body of `type`; the
+// response is sent once the reactor owns `c`. `extra` holds additional
+// CRLF-terminated header lines (or NULL). A 304 carries neither a body nor
+// entity headers.
+static void response_head(HttpConn *c, int status_code, const char *extra,
+                          const char *type, size_t length)
+{
+    if (status_code == 304) c->body_len = 0;
+    c->file_off = c->file_len = 0;
+    char conn_hdr[64];
+    if (c->keep_alive) {
+        snprintf(conn_hdr, sizeof(conn_hdr),
+                 "keep-alive\r\nKeep-Alive: timeout=%d, max=%d",
+                 HTTP_IDLE_TIMEOUT_MS / 1000, HTTP_MAX_REQUESTS - c->served);
+    } else {
+        snprintf(conn_hdr, sizeof(conn_hdr), "close");
+    }
+    char length_hdr[128] = "";
+    if (status_code != 304) {
+        snprintf(length_hdr, sizeof(length_hdr),
+                 "Content-Type: %s\r\nContent-Length: %zu\r\n", type, length);
+    }
+    c->hdr_len = (size_t)snprintf(c->hdr, sizeof(c->hdr),
+                        "HTTP/1.1 %d %s\r\n%s%sConnection: %s\r\n\r\n",
+                        status_code, status_text(status_code), length_hdr,
+                        extra ? extra : "", conn_hdr);
+    c->out_off = 0;
+}
+
+// The header for the JSON body already in c->body.
+static void set_response_head(HttpConn *c, int status_code, const char *extra)
+{
+    response_head(c, status_code, extra, "application/json", c->body_len);
+}
+
+// Prepare the response for `c` with a copy of `body`, of `type`.
+static void set_response_body(HttpConn *c, int status_code, const char *extra,
+                              const char *type, const void *body, size_t len)
+{
+    c->body_len = 0;
+    if (status_code != 304 && len > 0 && body_reserve(c, len)) {
+        memcpy(c->body, body, len);
+        c->body_len = len;
+    }
+    response_head(c, status_code, extra, type, c->body_len);
+}
+
+static void set_response_ex(HttpConn *c, int status_code, const char *extra,
+                            const char *body, size_t len)
+{
+    set_response_body(c, status_code, extra, "application/json", body, len);
+}
+
+static void set_response_status(HttpConn *c, int status_code, const char *body)
+{
+    set_response_ex(c, status_code, NULL, body, strlen(body));
+}
+
+static void set_response(HttpConn *c, const char *body)
+{
+    set_response_status(c, 200, body);
+}
+
+// ---------- CBOR ----------
+
+// Accept: application/cbor answers with the JSON objects encoded as CBOR
+// (RFC 8949): same keys, integers and booleans as such, strings as text.
+// The encoder appends to a caller's buffer; like snprintf, `len` keeps
+// counting past `cap`, so one check at the end catches truncation.
+typedef struct {
+    uint8_t *p;
+    size_t   cap;
+    size_t   len;
+} CborOut;
+
+static void cbor_put(CborOut *o, const void *data, size_t n)
+{
+    if (o->len < o->cap) {
+        size_t room = o->cap - o->len;
+        memcpy(o->p + o->len, data, n < room ? n : room);
+    }
+    o->len += n;
+}
+
+// An item head: major type plus its argument in the shortest encoding.
+static void cbor_head(CborOut *o, unsigned major, uint64_t v)
+{
+    uint8_t h[9];
+    size_t n = 1;
+    if (v < 24) {
+        h[0] = (uint8_t)(major << 5 | v);
+    } else {
+        int bytes = v <= 0xff ? 1 : v <= 0xffff ? 2 : v <= 0xffffffffu ? 4 : 8;
+        h[0] = (uint8_t)(major << 5 | (bytes == 1 ? 24 : bytes == 2 ? 25 : bytes == 4 ? 26 : 27));
+        for (int i = bytes - 1; i >= 0; i--) h[n++] = (uint8_t)(v >> (8 * i));
+    }
+    cbor_put(o, h, n);
+}
+
+static void cbor_uint(CborOut *o, uint64_t v)
+{
+    cbor_head(o, 0, v);
+}
+
+static void cbor_int(CborOut *o, long long v)
+{
+    if (v < 0) cbor_head(o, 1, (uint64_t)(-(v + 1)));
+    else cbor_head(o, 0, (uint64_t)v);
+}
+
+static void cbor_text(CborOut *o, const char *s)
+{
+    size_t n = strlen(s);
+    cbor_head(o, 3, n);
+    cbor_put(o, s, n);
+}
+
+static void cbor_bool(CborOut *o, bool v)
+{
+    uint8_t b = v ? 0xf5 : 0xf4;
+    cbor_put(o, &b, 1);
+}
+
+static void cbor_null(CborOut *o)
+{
+    uint8_t b = 0xf6;
+    cbor_put(o, &b, 1);
+}
+
+static void cbor_map(CborOut *o, size_t pairs)
+{
+    cbor_head(o, 5, pairs);
+}
+
+static void cbor_array(CborOut *o, size_t items)
+{
+    cbor_head(o, 4, items);
+}
+
+// An array whose length is not known yet; cbor_break() closes it.
+static void cbor_array_open(CborOut *o)
+{
+    uint8_t b = 0x9f;
+    cbor_put(o, &b, 1);
+}
+
+static void cbor_break(CborOut *o)
+{
+    uint8_t b = 0xff;
+    cbor_put(o, &b, 1);
+}
+
+// Map members
+static void cbor_kv_text(CborOut *o, const char *key, const char *v)
+{
+    cbor_text(o, key);
+    cbor_text(o, v);
+}
+
+static void cbor_kv_uint(CborOut *o, const char *key, uint64_t v)
+{
+    cbor_text(o, key);
+    cbor_uint(o, v);
+}
+
+static void cbor_kv_int(CborOut *o, const char *key, long long v)
+{
+    cbor_text(o, key);
+    cbor_int(o, v);
+}
+
+static void cbor_kv_bool(CborOut *o, const char *key, bool v)
+{
+    cbor_text(o, key);
+    cbor_bool(o, v);
+}
+
+// Prepare the response for `c` with the CBOR in `o`, which may already be
+// c->body.
+static void set_response_cbor(HttpConn *c, int status_code, const char *extra,
+                              const CborOut *o)
+{
+    if (o->len > o->cap) {
+        set_response_status(c, 500, "{\"error\":\"response too large\"}");
+    } else if (o->p == (uint8_t *)c->body) {
+        c->body_len = o->len;
+        response_head(c, status_code, extra, "application/cbor", c->body_len);
+    } else {
+        set_response_body(c, status_code, extra, "application/cbor", o->p, o->len);
+    }
+}
+
+// ---------- request slices ----------
+
+static bool slice_eq(HttpSlice s, const char *lit)
+{
+    size_t n = strlen(lit);
+    return s.len == n && memcmp(s.p, lit, n) == 0;
+}
+
+static bool slice_ieq(HttpSlice s, const char *lit)
+{
+    size_t n = strlen(lit);
+    return s.len == n && strncasecmp(s.p, lit, n) == 0;
+}
+
+// Copy into a NUL-terminated buffer, truncating if needed.
+static void slice_copy(char *out, size_t size, HttpSlice s)
+{
+    size_t n = (s.len < size - 1) ? s.len : size - 1;
+    if (n) memcpy(out, s.p, n);
+    out[n] = '\0';
+}
+
+// Decimal digits only; false on anything else or overflow.
+static bool slice_to_u64(HttpSlice s, unsigned long long *out)
+{
+    unsigned long long v = 0;
+    if (s.len == 0) return false;
+    for (size_t i = 0; i < s.len; i++) {
+        if (s.p[i] < '0' || s.p[i] > '9') return false;
+        unsigned d = (unsigned)(s.p[i] - '0');
+        if (v > (ULLONG_MAX - d) / 10) return false;
+        v = v * 10 + d;
+    }
+    *out = v;
+    return true;
+}
+
+// Header value by name (case-insensitive), from the parsed request.
+static bool req_header(const HttpConn *c, const char *name, HttpSlice *out)
+{
+    for (int i = 0; i < c->num_hdrs; i++) {
+        if (slice_ieq(c->hdrs[i].name, name)) {
+            *out = c->hdrs[i].value;
+            return true;
+        }
+    }
+    return false;
+}
+
+// True if a comma-separated value (e.g. Connection) lists `token`.
+static bool slice_has_token(HttpSlice v, const char *token)
+{
+    size_t tlen = strlen(token);
+    size_t i = 0;
+    while (i < v.len) {
+        while (i < v.len && (v.p[i] == ' ' || v.p[i] == ',')) i++;
+        size_t start = i;
+        while (i < v.len && v.p[i] != ',') i++;
+        size_t last = i;
+        while (last > start && v.p[last - 1] == ' ') last--;
+        if (last - start == tlen && strncasecmp(v.p + start, token, tlen) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// True if the Accept header lists the media type `type` (parameters such
+// as q= are ignored).
+static bool accepts(const HttpConn *c, const char *type)
+{
+    HttpSlice v;
+    if (!req_header(c, "Accept", &v)) return false;
+    size_t tlen = strlen(type);
+    size_t i = 0;
+    while (i < v.len) {
+        while (i < v.len && (v.p[i] == ' ' || v.p[i] == ',')) i++;
+        size_t start = i;
+        while (i < v.len && v.p[i] != ',' && v.p[i] != ';' && v.p[i] != ' ') i++;
+        if (i - start == tlen && strncasecmp(v.p + start, type, tlen) == 0) return true;
+        while (i < v.len && v.p[i] != ',') i++;
+    }
+    return false;
+}
+
+// Value of `key` in a form-encoded list (a query string or POST body):
+// module=D1&target=D0&action=LOCK
+static bool form_value(HttpSlice form, const char *key, HttpSlice *out)
+{
+    size_t klen = strlen(key);
+    const char *p = form.p, *end = form.p + form.len;
+    while (p && p < end) {
+        const char *amp = memchr(p, '&', (size_t)(end - p));
+        const char *stop = amp ? amp : end;
+        const char *eq = memchr(p, '=', (size_t)(stop - p));
+        if (eq && (size_t)(eq - p) == klen && memcmp(p, key, klen) == 0) {
+            out->p = eq + 1;
+            out->len = (size_t)(stop - eq - 1);
+            return true;
+        }
+        p = amp ? amp + 1 : NULL;
+    }
+    return false;
+}
+
+static bool query_value(const HttpConn *c, const char *key, HttpSlice *out)
+{
+    return form_value(c->query, key, out);
+}
+
+// Compare against the cached API token without an early exit, so the time
+// taken does not reveal how much of a guess was right.
+static bool token_matches(HttpSlice got)
+{
+    unsigned char diff = (got.len != g_api_token_len);
+    for (size_t i = 0; i < g_api_token_len; i++) {
+        unsigned char g = (i < got.len) ? (unsigned char)got.p[i] : 0;
+        diff |= (unsigned char)(g ^ (unsigned char)g_api_token[i]);
+    }
+    return diff == 0;
+}
+
+// True if the request path (query excluded) is `route`.
+static bool route_is(const HttpConn *c, const char *route)
+{
+    return slice_eq(c->path, route);
+}
+
+// ---------- connection table ----------
+
+static void dispatch(HttpConn *c);
+static void process_buffered(HttpConn *c);
+static void conn_respond(HttpConn *c);
+static void ws_job_done(HttpConn *c);
+static void batch_job_done(HttpConn *c);
+static void batch_finish(HttpConn *c);
+static void handle_ws(HttpConn *c);
+static bool ws_on_result(const HubBusEvent *ev);
+
+static void conn_close(HttpConn *c)
+{
+    if (c->fd >= 0) {
+        epoll_ctl(g_epfd, EPOLL_CTL_DEL, c->fd, NULL);
+        close(c->fd);
+    }
+    pool_put(&g_req_pool, c->req);
+    pool_put(&g_stream_pool, c->sbuf);
+    free(c->body);
+    free(c->batch);
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+    c->state = CONN_FREE;
+}
+
+// Set the epoll interest for `c`. 0 removes it from the set, which is used
+// while a worker or a parked command owns the request so that a hang-up
+// cannot make the level-triggered epoll spin meanwhile.
+static void conn_watch(HttpConn *c, uint32_t events)
+{
+    if (events == c->events) return;
+    struct epoll_event ev = { .events = events,
+                              .data.u32 = (uint32_t)(c - g_conns) };
+    if (events == 0) {
+        epoll_ctl(g_epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    } else {
+        epoll_ctl(g_epfd, c->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, c->fd, &ev);
+    }
+    c->events = events;
+}
+
+// Returns true when everything has been sent. Header and body go out in
+// one sendmsg(), so a response normally costs a single syscall and leaves
+// as one segment rather than a lone header waiting on the peer's ACK. A
+// static file follows with sendfile(); MSG_MORE holds the header for it.
+static bool conn_flush(HttpConn *c)
+{
+    while (c->out_off < c->hdr_len + c->body_len) {
+        struct iovec iov[2];
+        int iovcnt = 0;
+        if (c->out_off < c->hdr_len) {
+            iov[iovcnt].iov_base = c->hdr + c->out_off;
+            iov[iovcnt].iov_len = c->hdr_len - c->out_off;
+            iovcnt++;
+        }
+        if (c->body_len) {
+            size_t body_off = (c->out_off > c->hdr_len) ? c->out_off - c->hdr_len : 0;
+            iov[iovcnt].iov_base = c->body + body_off;
+            iov[iovcnt].iov_len = c->body_len - body_off;
+            iovcnt++;
+        }
+        struct msghdr msg = { .msg_iov = iov, .msg_iovlen = (size_t)iovcnt };
+        int flags = MSG_NOSIGNAL | (c->file_len ? MSG_MORE : 0);
+        ssize_t n = sendmsg(c->fd, &msg, flags);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return false;
+            c->out_off = c->hdr_len + c->body_len;   // peer gone; give up
+            c->file_off = c->file_len;
+            return true;
+        }
+        c->out_off += (size_t)n;
+    }
+    while (c->file_off < c->file_len) {
+        off_t off = (off_t)c->file_off;
+        ssize_t n = sendfile(c->fd, c->file_fd, &off, c->file_len - c->file_off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return false;
+        if (n <= 0) {
+            // Peer gone, or the file shrank below the announced length:
+            // the response cannot be completed, so neither can the
+            // connection.
+            c->file_off = c->file_len;
+            c->keep_alive = false;
+            return true;
+        }
+        c->file_off += (size_t)n;
+    }
+    return true;
+}
+
+// Forget the parsed request; the next one starts at req[0].
+static void parse_reset(HttpConn *c)
+{
+    c->parse = PARSE_LINE;
+    c->scan = 0;
+    c->body_off = 0;
+    c->content_length = 0;
+    c->has_length = false;
+    c->num_hdrs = 0;
+    c->method = c->path = c->query = c->version = c->req_body = (HttpSlice){ NULL, 0 };
+}
+
+// Response fully written: close, or drop the handled request from the
+// buffer and wait for the next one (which may already be buffered).
+static void conn_finish(HttpConn *c)
+{
+    if (!c->keep_alive) {
+        conn_close(c);
+        return;
+    }
+    // A big history page must not stay pinned to an idle keep-alive
+    // connection; small bodies are kept for the next response.
+    if (c->body_cap > HTTP_BODY_KEEP) {
+        free(c->body);
+        c->body = NULL;
+        c->body_cap = 0;
+    }
+    size_t rest = c->req_len - c->req_total;
+    memmove(c->req, c->req + c->req_total, rest);
+    c->req_len = rest;
+    c->req_total = 0;
+    parse_reset(c);
+    c->state = CONN_READING;
+    c->deadline_ms = now_ms() +
+                     (rest ? HTTP_IO_TIMEOUT_MS : HTTP_IDLE_TIMEOUT_MS);
+    conn_watch(c, EPOLLIN | EPOLLRDHUP);
+}
+
+// Start sending the prepared response.
+static void conn_start_write(HttpConn *c)
+{
+    c->state = CONN_WRITING;
+    c->deadline_ms = now_ms() + HTTP_IO_TIMEOUT_MS;
+    if (conn_flush(c)) {
+        conn_finish(c);
+        return;
+    }
+    conn_watch(c, EPOLLOUT);
+}
+
+// ---------- worker pool ----------
+
+static void offload(HttpConn *c, JobKind job)
+{
+    c->job = job;
+    c->state = CONN_WORKING;
+    conn_watch(c, 0);
+    pthread_mutex_lock(&g_q_lock);
+    g_jobs[(g_job_head + g_job_count) % HTTP_MAX_CONNS] = (int)(c - g_conns);
+    g_job_count++;
+    pthread_cond_signal(&g_q_cond);
+    pthread_mutex_unlock(&g_q_lock);
+}
+
+// Local-module requests call into doorMod, which samples the distance
+// sensor and drives the motor, so they run here rather than on the reactor.
+// Move the local door for `action`. Returns false for an unknown action.
+static bool local_command(const char *action, Door_t *d)
+{
+    if (strcmp(action, "LOCK") == 0) {
+        *d = lockDoor(d);
+    } else if (strcmp(action, "UNLOCK") == 0) {
+        *d = unlockDoor(d);
+    } else if (strcmp(action, "STATUS") == 0) {
+        *d = get_door_status(d);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// The same, describing the outcome as a JSON object in out.
+static void run_local_command(const char *action, char *out, size_t size)
+{
+    Door_t d = { .state = UNKNOWN };
+    if (!local_command(action, &d)) {
+        snprintf(out, size, "{\"error\":\"unknown action\"}");
+        return;
+    }
+    snprintf(out, size, "{\"result\":\"ok\",\"state\":%d}", d.state);
+}
+
+static void batch_run_local(HttpConn *c);
+
+static void run_job(HttpConn *c)
+{
+    Door_t d = { .state = UNKNOWN };
+    char out[256];
+
+    if (c->job == JOB_BATCH_LOCAL) {
+        batch_run_local(c);
+        return;
+    }
+
+    if (c->job == JOB_LOCAL_STATUS && c->cbor) {
+        d = get_door_status(&d);
+        uint8_t buf[128];
+        CborOut o = { buf, sizeof(buf), 0 };
+        cbor_map(&o, 4);
+        cbor_kv_text(&o, "module", c->mod);
+        cbor_kv_int(&o, "state", d.state);
+        cbor_kv_bool(&o, "front_door_open", d.state == OPEN);
+        cbor_kv_bool(&o, "front_lock_locked", d.state == LOCKED);
+        set_response_cbor(c, 200, NULL, &o);
+        return;
+    }
+
+    if (c->job == JOB_LOCAL_STATUS) {
+        d = get_door_status(&d);
+        // Map Door_t state to friendly booleans for front door and lock
+        const char *front_open = (d.state == OPEN) ? "true" : "false";
+        const char *front_locked = (d.state == LOCKED) ? "true" : "false";
+        snprintf(out, sizeof(out), "{\"module\":\"%s\",\"state\":%d,\"front_door_open\":%s,\"front_lock_locked\":%s}",
+                 c->mod, d.state, front_open, front_locked);
+        set_response(c, out);
+        return;
+    }
+
+    if (c->cbor) {
+        uint8_t buf[64];
+        CborOut o = { buf, sizeof(buf), 0 };
+        if (local_command(c->action, &d)) {
+            cbor_map(&o, 2);
+            cbor_kv_text(&o, "result", "ok");
+            cbor_kv_int(&o, "state", d.state);
+        } else {
+            cbor_map(&o, 1);
+            cbor_kv_text(&o, "error", "unknown action");
+        }
+        set_response_cbor(c, 200, NULL, &o);
+        return;
+    }
+
+    run_local_command(c->action, out, sizeof(out));
+    set_response(c, out);
+}
+
+static void *worker_loop(void *arg)
+{
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&g_q_lock);
+        while (g_job_count == 0 && !g_workers_stop) {
+            pthread_cond_wait(&g_q_cond, &g_q_lock);
+        }
+        if (g_job_count == 0) {
+            pthread_mutex_unlock(&g_q_lock);
+            break;
+        }
+        int idx = g_jobs[g_job_head];
+        g_job_head = (g_job_head + 1) % HTTP_MAX_CONNS;
+        g_job_count--;
+        pthread_mutex_unlock(&g_q_lock);
+
+        pthread_mutex_lock(&g_local_lock);
+        run_job(&g_conns[idx]);
+        pthread_mutex_unlock(&g_local_lock);
+
+        pthread_mutex_lock(&g_q_lock);
+        g_done[(g_done_head + g_done_count) % HTTP_MAX_CONNS] = idx;
+        g_done_count++;
+        pthread_mutex_unlock(&g_q_lock);
+        uint64_t one = 1;
+        ssize_t n = write(g_wakefd, &one, sizeof(one));
+        (void)n;
+    }
+    return NULL;
+}
+
+static void drain_done_queue(void)
+{
+    uint64_t v;
+    ssize_t n = read(g_wakefd, &v, sizeof(v));
+    (void)n;
+    while (1) {
+        pthread_mutex_lock(&g_q_lock);
+        if (g_done_count == 0) {
+            pthread_mutex_unlock(&g_q_lock);
+            return;
+        }
+        int idx = g_done[g_done_head];
+        g_done_head = (g_done_head + 1) % HTTP_MAX_CONNS;
+        g_done_count--;
+        pthread_mutex_unlock(&g_q_lock);
+        if (g_conns[idx].ws) {
+            ws_job_done(&g_conns[idx]);
+        } else if (g_conns[idx].batch) {
+            batch_job_done(&g_conns[idx]);
+        } else {
+            conn_respond(&g_conns[idx]);
+        }
+    }
+}
+
+// ---------- event streams (SSE and WebSocket) ----------
+
+// Write `src` as JSON string content (no quotes) into out. Returns the
+// length written, or -1 if it does not fit.
+static int json_escape(char *out, size_t size, const char *src)
+{
+    size_t n = 0;
+    for (const unsigned char *p = (const unsigned char *)src; *p; p++) {
+        char piece[8];
+        size_t plen = 2;
+        switch (*p) {
+            case '"':  memcpy(piece, "\\\"", 2); break;
+            case '\\': memcpy(piece, "\\\\", 2); break;
+            case '\n': memcpy(piece, "\\n", 2);  break;
+            case '\r': memcpy(piece, "\\r", 2);  break;
+            case '\t': memcpy(piece, "\\t", 2);  break;
+            default:
+                if (*p < 0x20) {
+                    plen = (size_t)snprintf(piece, sizeof(piece), "\\u%04x", *p);
+                } else {
+                    piece[0] = (char)*p;
+                    plen = 1;
+                }
+        }
+        if (n + plen >= size) return -1;
+        memcpy(out + n, piece, plen);
+        n += plen;
+    }
+    out[n] = '\0';
+    return (int)n;
+}
+
+// Queue bytes on a stream. Returns false when the client's buffer is full.
+static bool stream_append(HttpConn *c, const char *data, size_t len)
+{
+    if (c->sbuf_len + len > HTTP_SSE_BUF && c->sbuf_off > 0) {
+        memmove(c->sbuf, c->sbuf + c->sbuf_off, c->sbuf_len - c->sbuf_off);
+        c->sbuf_len -= c->sbuf_off;
+        c->sbuf_off = 0;
+    }
+    if (c->sbuf_len + len > HTTP_SSE_BUF) return false;
+    if (c->sbuf_len == c->sbuf_off) {
+        c->deadline_ms = now_ms() + HTTP_SSE_STALL_MS;
+    }
+    memcpy(c->sbuf + c->sbuf_len, data, len);
+    c->sbuf_len += len;
+    return true;
+}
+
+// Send what the socket accepts. Returns false if the client is gone.
+static bool stream_flush(HttpConn *c)
+{
+    while (c->sbuf_off < c->sbuf_len) {
+        ssize_t n = send(c->fd, c->sbuf + c->sbuf_off,
+                         c->sbuf_len - c->sbuf_off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return false;
+        }
+        c->sbuf_off += (size_t)n;
+        c->deadline_ms = now_ms() + HTTP_SSE_STALL_MS;
+    }
+    if (c->sbuf_off == c->sbuf_len) {
+        c->sbuf_off = c->sbuf_len = 0;
+        c->deadline_ms = now_ms() + HTTP_SSE_PING_MS;
+        conn_watch(c, EPOLLIN | EPOLLRDHUP);
+    } else {
+        conn_watch(c, EPOLLIN | EPOLLRDHUP | EPOLLOUT);
+    }
+    return true;
+}
+
+// Heartbeat sampling slot for `module_id` (NULL if the table is full).
+static long long *stream_hb_slot(HttpConn *c, const char *module_id)
+{
+    for (int i = 0; i < HUB_MAX_DOORS; i++) {
+        if (c->hb_sent[i].module_id[0] == '\0') {
+            snprintf(c->hb_sent[i].module_id, sizeof(c->hb_sent[i].module_id),
+                     "%s", module_id);
+            c->hb_sent[i].last_ms = 0;
+            return &c->hb_sent[i].last_ms;
+        }
+        if (strcmp(c->hb_sent[i].module_id, module_id) == 0) {
+            return &c->hb_sent[i].last_ms;
+        }
+    }
+    return NULL;
+}
+
+// WebSocket opcodes used by the hub
+#define WS_OP_TEXT  0x1
+#define WS_OP_CLOSE 0x8
+#define WS_OP_PING  0x9
+#define WS_OP_PONG  0xa
+
+// Frame `len` payload bytes as one final, unmasked WebSocket frame (server
+// frames are never masked). Returns the frame length, 0 if it does not fit.
+static size_t ws_frame(char *out, size_t size, int opcode,
+                       const char *payload, size_t len)
+{
+    size_t hdr = (len < 126) ? 2 : 4;
+    if (len > 0xffff || hdr + len > size) return 0;
+    out[0] = (char)(0x80 | opcode);
+    if (len < 126) {
+        out[1] = (char)len;
+    } else {
+        out[1] = 126;
+        out[2] = (char)(len >> 8);
+        out[3] = (char)(len & 0xff);
+    }
+    if (len) memcpy(out + hdr, payload, len);
+    return hdr + len;
+}
+
+// "The history overtook you" notice, in the stream's own framing.
+static size_t format_gap(const HttpConn *c, char *out, size_t size,
+                         unsigned long long missed)
+{
+    if (!c->ws) {
+        return (size_t)snprintf(out, size,
+                                "event: gap\ndata: {\"missed\":%llu}\n\n", missed);
+    }
+    char p[64];
+    int n = snprintf(p, sizeof(p), "{\"type\":\"gap\",\"missed\":%llu}", missed);
+    return ws_frame(out, size, WS_OP_TEXT, p, (size_t)n);
+}
+
+static size_t format_event(const HttpConn *c, char *out, size_t size,
+                           const HubEvent *e)
+{
+    const char *name = hub_bus_type_name((HubEventType)e->type);
+    char id[6 * HUB_MODULE_ID_LEN], line[2 * HUB_LINE_LEN];
+    json_escape(id, sizeof(id), e->module_id);
+    if (json_escape(line, sizeof(line), e->line) < 0) line[0] = '\0';
+    if (!c->ws) {
+        return (size_t)snprintf(out, size,
+                                "id: %llu\nevent: %s\ndata: {\"seq\":%llu,\"ts\":%lld,"
+                                "\"module\":\"%s\",\"type\":\"%s\",\"line\":\"%s\"}\n\n",
+                                (unsigned long long)e->seq, name,
+                                (unsigned long long)e->seq, e->timestamp_ms,
+                                id, name, line);
+    }
+    char p[2 * HUB_LINE_LEN + 6 * HUB_MODULE_ID_LEN + 128];
+    int n = snprintf(p, sizeof(p),
+                     "{\"type\":\"event\",\"seq\":%llu,\"ts\":%lld,\"module\":\"%s\","
+                     "\"event\":\"%s\",\"line\":\"%s\"}",
+                     (unsigned long long)e->seq, e->timestamp_ms,
+                     id, name, line);
+    return ws_frame(out, size, WS_OP_TEXT, p, (size_t)n);
+}
+
+// Move history entries past the client's cursor into its buffer until it
+// is up to date or the buffer is full; in the latter case the cursor stays
+// put and the client catches up as it drains (per-client backpressure).
+// WebSocket streams leave HTTP_WS_RESERVE bytes for command results.
+static void stream_pump(HttpConn *c)
+{
+    size_t limit = HTTP_SSE_BUF - (c->ws ? HTTP_WS_RESERVE : 0);
+    HubEvent evs[16];
+    int n;
+    while ((n = hub_udp_get_history_since(c->cursor, evs, 16)) > 0) {
+        for (int i = 0; i < n; i++) {
+            const HubEvent *e = &evs[i];
+            char msg[2 * HUB_LINE_LEN + 6 * HUB_MODULE_ID_LEN + 320];
+            size_t len = 0;
+
+            if (e->seq > c->cursor + 1) {
+                // The history ring overtook this client.
+                len = format_gap(c, msg, sizeof(msg),
+                                 (unsigned long long)(e->seq - c->cursor - 1));
+            }
+
+            bool wanted = (c->type_mask & (uint32_t)e->type) &&
+                          (!c->filter_mod[0] ||
+                           strcmp(c->filter_mod, e->module_id) == 0);
+            long long *hb_last = NULL;
+            if (wanted && e->type == HUB_EV_HEARTBEAT && c->hb_every_ms > 0) {
+                hb_last = stream_hb_slot(c, e->module_id);
+                if (hb_last && *hb_last &&
+                    e->timestamp_ms - *hb_last < c->hb_every_ms) {
+                    wanted = false;
+                }
+            }
+
+            if (wanted) len += format_event(c, msg + len, sizeof(msg) - len, e);
+
+            if (len > 0 && (c->sbuf_len - c->sbuf_off + len > limit ||
+                            !stream_append(c, msg, len))) {
+                return;
+            }
+            if (wanted && hb_last) *hb_last = e->timestamp_ms;
+            c->cursor = e->seq;
+        }
+    }
+}
+
+// Refill and flush a stream; closes it if the client has gone away.
+static void export_pump(HttpConn *c);
+
+// Live streams are refilled when the bus reports new events; an export
+// refills itself until the socket pushes back or it is complete.
+static void stream_service(HttpConn *c)
+{
+    do {
+        if (c->exporting) {
+            export_pump(c);
+        } else {
+            stream_pump(c);
+        }
+        if (!stream_flush(c)) {
+            conn_close(c);
+            return;
+        }
+    } while (c->exporting && !c->export_done && c->sbuf_off == c->sbuf_len);
+    if (c->export_done && c->sbuf_off == c->sbuf_len) conn_close(c);
+}
+
+// Anything a stream client sends is ignored; EOF or an error ends it.
+static void stream_read(HttpConn *c)
+{
+    char scratch[512];
+    while (1) {
+        ssize_t n = recv(c->fd, scratch, sizeof(scratch), 0);
+        if (n > 0) continue;
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        conn_close(c);
+        return;
+    }
+}
+
+static uint32_t parse_type_list(HttpSlice list)
+{
+    if (slice_eq(list, "all")) return HUB_EV_ALL;
+    uint32_t mask = 0;
+    for (int i = 0; i < HUB_EV_TYPE_COUNT; i++) {
+        HubEventType t = (HubEventType)(1u << i);
+        if (slice_has_token(list, hub_bus_type_name(t))) mask |= (uint32_t)t;
+    }
+    return mask;
+}
+
+// Set up the stream filters and starting cursor from the request and queue
+// `head` (the response header). Shared by SSE and WebSocket streams:
+//   ?types=door,lock,...|all  &module=D1  &heartbeat_ms=N  &last_event_id=N
+// Resumes after Last-Event-ID (or ?last_event_id=) when the client sends
+// one; otherwise starts with the next event. Returns false if an error
+// response was sent instead.
+static bool stream_begin(HttpConn *c, const char *head, size_t head_len);
+
+static bool stream_open(HttpConn *c, const char *head, size_t head_len)
+{
+    HttpSlice v;
+    unsigned long long n;
+    c->type_mask = HTTP_SSE_DEFAULT_TYPES;
+    if (query_value(c, "types", &v)) c->type_mask = parse_type_list(v);
+    if (query_value(c, "module", &v)) slice_copy(c->filter_mod, sizeof(c->filter_mod), v);
+    if (query_value(c, "heartbeat_ms", &v) && slice_to_u64(v, &n)) {
+        c->hb_every_ms = (n > INT_MAX) ? INT_MAX : (int)n;
+    }
+
+    uint64_t latest = hub_udp_history_seq();
+    c->cursor = latest;
+    if ((req_header(c, "Last-Event-ID", &v) || query_value(c, "last_event_id", &v)) &&
+        slice_to_u64(v, &n)) {
+        // An id beyond the newest entry predates a hub restart: replay
+        // everything still in the history.
+        c->cursor = (n <= latest) ? n : 0;
+    }
+
+    return stream_begin(c, head, head_len);
+}
+
+// Turn `c` into a stream and queue `head`. Returns false if an error
+// response was sent instead.
+static bool stream_begin(HttpConn *c, const char *head, size_t head_len)
+{
+    c->sbuf = pool_get(&g_stream_pool);
+    if (!c->sbuf) {
+        c->ws = false;
+        c->exporting = false;
+        set_response_status(c, 503, "{\"error\":\"out of memory\"}");
+        conn_start_write(c);
+        return false;
+    }
+    c->state = CONN_STREAM;
+    c->keep_alive = false;
+    // Keep at most one stream buffer of unsent data in the kernel. A slow
+    // client then backs up into sbuf, where it is reported as a gap,
+    // instead of into a socket buffer of stale events.
+    int lowat = HTTP_SSE_BUF;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat));
+    stream_append(c, head, head_len);
+    return true;
+}
+
+// GET /api/events: Server-Sent Events.
+static void handle_events(HttpConn *c)
+{
+    static const char head[] =
+        "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"
+        "Cache-Control: no-cache\r\n\r\nretry: 2000\n\n";
+    if (stream_open(c, head, sizeof(head) - 1)) stream_service(c);
+}
+
+// ---------- history export ----------
+
+// One NDJSON line per entry, or a gap record for entries that were
+// overwritten before the export reached them.
+static bool export_line(const HubEvent *e, void *ctx)
+{
+    HttpConn *c = ctx;
+    char msg[2 * HUB_LINE_LEN + 6 * HUB_MODULE_ID_LEN + 256];
+    size_t len = 0;
+    if (e->seq > c->cursor + 1) {
+        uint64_t end = (e->seq <= c->export_end) ? e->seq : c->export_end + 1;
+        len = (size_t)snprintf(msg, sizeof(msg), "{\"type\":\"gap\",\"missed\":%llu}\n",
+                               (unsigned long long)(end - c->cursor - 1));
+    }
+    bool past_end = e->seq > c->export_end;
+    bool wanted = !past_end &&
+                  (!c->type_mask || (c->type_mask & (uint32_t)e->type)) &&
+                  (!c->filter_mod[0] || strcmp(c->filter_mod, e->module_id) == 0);
+    if (wanted) {
+        char id[6 * HUB_MODULE_ID_LEN], line[2 * HUB_LINE_LEN];
+        json_escape(id, sizeof(id), e->module_id);
+        if (json_escape(line, sizeof(line), e->line) < 0) line[0] = '\0';
+        len += (size_t)snprintf(msg + len, sizeof(msg) - len,
+                                "{\"seq\":%llu,\"ts\":%lld,\"module\":\"%s\","
+                                "\"type\":\"%s\",\"line\":\"%s\"}\n",
+                                (unsigned long long)e->seq, e->timestamp_ms, id,
+                                hub_bus_type_name((HubEventType)e->type), line);
+    }
+    // Leave room for the chunk's trailing CRLF.
+    if (c->sbuf_len + len + 2 > HTTP_SSE_BUF) return false;
+    memcpy(c->sbuf + c->sbuf_len, msg, len);
+    c->sbuf_len += len;
+    c->cursor = past_end ? c->export_end : e->seq;
+    return !past_end;
+}
+
+// Queue as much of the export as fits in the stream buffer as one chunk.
+// The walk resumes at the cursor, so memory use does not depend on the
+// size of the export; a slow client simply leaves the buffer full.
+static void export_pump(HttpConn *c)
+{
+    if (c->export_done) return;
+    if (c->sbuf_off > 0) {
+        memmove(c->sbuf, c->sbuf + c->sbuf_off, c->sbuf_len - c->sbuf_off);
+        c->sbuf_len -= c->sbuf_off;
+        c->sbuf_off = 0;
+    }
+    size_t start = c->sbuf_len;
+    size_t head = c->chunked ? 6 : 0;   // "%04zx\r\n"; a chunk is < 64 KB
+    if (c->cursor < c->export_end && start + head + 2 * HUB_LINE_LEN + 256 <= HTTP_SSE_BUF) {
+        c->sbuf_len += head;
+        int n = hub_udp_visit_history(NULL, 0, c->cursor, export_line, c, NULL);
+        // Nothing newer than the cursor is left (history reset).
+        if (n == 0) c->cursor = c->export_end;
+        size_t payload = c->sbuf_len - start - head;
+        if (payload == 0) {
+            c->sbuf_len = start;
+        } else if (c->chunked) {
+            char size[24];
+            snprintf(size, sizeof(size), "%04zx\r\n", payload);
+            memcpy(c->sbuf + start, size, head);
+            memcpy(c->sbuf + c->sbuf_len, "\r\n", 2);
+            c->sbuf_len += 2;
+        }
+    }
+    if (c->cursor >= c->export_end) {
+        if (!c->chunked) {
+            c->export_done = true;
+        } else if (stream_append(c, "0\r\n\r\n", 5)) {
+            c->export_done = true;
+        }
+    }
+}
+
+static bool export_first_seq(const HubEvent *e, void *ctx)
+{
+    *(uint64_t *)ctx = e->seq;
+    return false;
+}
+
+// GET /api/history/export?module=D1&type=door,lock&since_seq=N
+// Every history entry after since_seq (default: all that are kept) as
+// NDJSON, up to the newest entry at the time of the request, then the
+// connection closes.
+static void handle_history_export(HttpConn *c)
+{
+    HttpSlice v, since_v;
+    unsigned long long since = 0;
+    bool has_since = query_value(c, "since_seq", &since_v);
+    c->type_mask = 0;
+    if (query_value(c, "module", &v)) slice_copy(c->filter_mod, sizeof(c->filter_mod), v);
+    if ((has_since && !slice_to_u64(since_v, &since)) ||
+        (query_value(c, "type", &v) && (c->type_mask = parse_type_list(v)) == 0)) {
+        set_response_status(c, 400, "{\"error\":\"bad query\"}");
+        conn_start_write(c);
+        return;
+    }
+    if (!has_since) {
+        // Start at the oldest entry kept, so only entries lost during the
+        // export are reported as a gap.
+        uint64_t first = 0;
+        hub_udp_visit_history(NULL, 0, 0, export_first_seq, &first, NULL);
+        if (first > 0) since = first - 1;
+    }
+    c->cursor = since;
+    c->export_end = hub_udp_history_seq();
+    c->chunked = slice_eq(c->version, "HTTP/1.1");
+    c->exporting = true;
+
+    char head[192];
+    int n = snprintf(head, sizeof(head),
+                     "HTTP/1.1 200 OK\r\nContent-Type: application/x-ndjson\r\n%s"
+                     "Cache-Control: no-cache\r\nConnection: close\r\n\r\n",
+                     c->chunked ? "Transfer-Encoding: chunked\r\n" : "");
+    if (stream_begin(c, head, (size_t)n)) stream_service(c);
+}
+
+// ---------- asynchronous commands ----------
+
+// POST /api/command?async=1 is answered 202 with the cmdid right away; the
+// outcome is recorded here when its COMMAND_RESULT arrives and read back
+// with GET /api/command/{id}. Hub cmdids are sequential, so records are
+// indexed by cmdid modulo the table size and each one lives until its slot
+// is reused HTTP_CMD_RECORDS commands later. Only the reactor touches it.
+typedef struct {
+    int  cmdid;                     // 0 = free
+    char mod[HUB_MODULE_ID_LEN];
+    char target[32];
+    char action[32];
+    int  result;                    // 0 pending, 1 acked, -1 failed
+    int  rtt_ms;
+    char feedback[32];              // module's FEEDBACK action when acked
+    char reason[12];                // why it failed
+} HttpCmdRecord;
+
+static HttpCmdRecord g_cmd_records[HTTP_CMD_RECORDS];
+
+// The "reason" reported for a failed COMMAND_RESULT.
+static const char *result_reason(const HubBusEvent *ev)
+{
+    return ev->reason[0] ? ev->reason : "no_ack";
+}
+
+static HttpCmdRecord *cmd_record(int cmdid)
+{
+    HttpCmdRecord *r = &g_cmd_records[(unsigned)cmdid % HTTP_CMD_RECORDS];
+    return (cmdid > 0 && r->cmdid == cmdid) ? r : NULL;
+}
+
+static void cmd_record_add(const HttpConn *c, int cmdid)
+{
+    HttpCmdRecord *r = &g_cmd_records[(unsigned)cmdid % HTTP_CMD_RECORDS];
+    memset(r, 0, sizeof(*r));
+    r->cmdid = cmdid;
+    snprintf(r->mod, sizeof(r->mod), "%s", c->mod);
+    snprintf(r->target, sizeof(r->target), "%s", c->target);
+    snprintf(r->action, sizeof(r->action), "%s", c->action);
+}
+
+static void cmd_record_result(const HubBusEvent *ev)
+{
+    HttpCmdRecord *r = cmd_record(ev->cmdid);
+    if (!r || strcmp(r->mod, ev->module_id) != 0) return;
+    r->result = ev->state ? 1 : -1;
+    r->rtt_ms = ev->rtt_ms;
+    snprintf(r->reason, sizeof(r->reason), "%s", result_reason(ev));
+    snprintf(r->feedback, sizeof(r->feedback), "%s", ev->feedback);
+}
+
+// GET /api/command/{id}: pending, acked (with rtt_ms) or failed.
+static void handle_command_status(HttpConn *c, HttpSlice id)
+{
+    unsigned long long v;
+    bool valid = slice_to_u64(id, &v) && v > 0 && v <= INT_MAX;
+    HttpCmdRecord *r = valid ? cmd_record((int)v) : NULL;
+    if (!r) {
+        set_response_status(c, 404, "{\"error\":\"unknown command\"}");
+        conn_start_write(c);
+        return;
+    }
+
+    if (c->cbor) {
+        uint8_t buf[256];
+        CborOut o = { buf, sizeof(buf), 0 };
+        cbor_map(&o, r->result ? 7 : 5);
+        cbor_kv_int(&o, "cmdid", r->cmdid);
+        cbor_kv_text(&o, "module", r->mod);
+        cbor_kv_text(&o, "target", r->target);
+        cbor_kv_text(&o, "action", r->action);
+        cbor_kv_text(&o, "state", r->result > 0 ? "acked" : r->result < 0 ? "failed" : "pending");
+        if (r->result) {
+            cbor_kv_int(&o, "rtt_ms", r->rtt_ms);
+            if (r->result > 0) cbor_kv_text(&o, "feedback", r->feedback);
+            else cbor_kv_text(&o, "reason", r->reason);
+        }
+        set_response_cbor(c, 200, "Cache-Control: no-cache\r\n", &o);
+        conn_start_write(c);
+        return;
+    }
+
+    char mod[6 * HUB_MODULE_ID_LEN], target[64], action[64], feedback[64];
+    if (json_escape(mod, sizeof(mod), r->mod) < 0) mod[0] = '\0';
+    if (json_escape(target, sizeof(target), r->target) < 0) target[0] = '\0';
+    if (json_escape(action, sizeof(action), r->action) < 0) action[0] = '\0';
+    if (json_escape(feedback, sizeof(feedback), r->feedback) < 0) feedback[0] = '\0';
+    char out[512];
+    int n = snprintf(out, sizeof(out),
+                     "{\"cmdid\":%d,\"module\":\"%s\",\"target\":\"%s\",\"action\":\"%s\",\"state\":\"%s\"",
+                     r->cmdid, mod, target, action,
+                     r->result > 0 ? "acked" : r->result < 0 ? "failed" : "pending");
+    if (r->result > 0) {
+        n += snprintf(out + n, sizeof(out) - (size_t)n,
+                      ",\"rtt_ms\":%d,\"feedback\":\"%s\"}", r->rtt_ms, feedback);
+    } else if (r->result < 0) {
+        n += snprintf(out + n, sizeof(out) - (size_t)n,
+                      ",\"rtt_ms\":%d,\"reason\":\"%s\"}", r->rtt_ms, r->reason);
+    } else {
+        n += snprintf(out + n, sizeof(out) - (size_t)n, "}");
+    }
+    set_response_ex(c, 200, "Cache-Control: no-cache\r\n", out, (size_t)n);
+    conn_start_write(c);
+}
+
+// ---------- static files ----------
+
+static const char *static_type(const char *name)
+{
+    static const struct { const char *ext, *type; } types[] = {
+        { ".html", "text/html; charset=utf-8" },
+        { ".css",  "text/css; charset=utf-8" },
+        { ".js",   "application/javascript; charset=utf-8" },
+        { ".svg",  "image/svg+xml" },
+        { ".png",  "image/png" },
+        { ".jpg",  "image/jpeg" },
+        { ".ico",  "image/x-icon" },
+    };
+    size_t len = strlen(name);
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        size_t ext = strlen(types[i].ext);
+        if (len > ext && strcmp(name + len - ext, types[i].ext) == 0) return types[i].type;
+    }
+    return NULL;
+}
+
+// Open a regular file of the static directory. Returns its fd, or -1.
+static int static_open(int dir_fd, const char *name, size_t *size, char *etag,
+                       size_t etag_size, const char *suffix)
+{
+    int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return -1;
+    }
+    *size = (size_t)st.st_size;
+    snprintf(etag, etag_size, "\"%llx-%llx%s\"", (unsigned long long)st.st_size,
+             (unsigned long long)st.st_mtim.tv_sec, suffix);
+    return fd;
+}
+
+// Index the web files (by extension) of `dir`, and a pre-compressed
+// <name>.gz beside any of them. Subdirectories are not served.
+static void static_load(const char *dir)
+{
+    DIR *d = opendir(dir);
+    if (!d) {
+        perror("http_api: HTTP_STATIC_DIR");
+        return;
+    }
+    int dir_fd = dirfd(d);
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL && g_static_count < HTTP_STATIC_MAX) {
+        StaticFile *f = &g_static[g_static_count];
+        const char *type = static_type(de->d_name);
+        size_t len = strlen(de->d_name);
+        if (!type || len >= sizeof(f->name)) continue;
+        f->fd = static_open(dir_fd, de->d_name, &f->size, f->etag, sizeof(f->etag), "");
+        if (f->fd < 0) continue;
+        memcpy(f->name, de->d_name, len + 1);
+        f->type = type;
+
+        char gz[sizeof(f->name) + 3];
+        snprintf(gz, sizeof(gz), "%s.gz", f->name);
+        f->gz_fd = static_open(dir_fd, gz, &f->gz_size, f->gz_etag, sizeof(f->gz_etag), "-gz");
+        g_static_count++;
+    }
+    closedir(d);
+    fprintf(stderr, "HTTP API serving %d static files from %s\n", g_static_count, dir);
+}
+
+static void static_unload(void)
+{
+    for (int i = 0; i < g_static_count; i++) {
+        close(g_static[i].fd);
+        if (g_static[i].gz_fd >= 0) close(g_static[i].gz_fd);
+    }
+    g_static_count = 0;
+}
+
+// GET or HEAD of a static file; "/" is index.html. Returns false if there
+// is no such file.
+static bool handle_static(HttpConn *c, bool head)
+{
+    HttpSlice name = { c->path.p + 1, c->path.len - 1 };
+    if (name.len == 0) name = (HttpSlice){ "index.html", 10 };
+    const StaticFile *f = NULL;
+    for (int i = 0; i < g_static_count && !f; i++) {
+        if (slice_eq(name, g_static[i].name)) f = &g_static[i];
+    }
+    if (!f) return false;
+
+    HttpSlice v;
+    bool gz = f->gz_fd >= 0 && req_header(c, "Accept-Encoding", &v) &&
+              slice_has_token(v, "gzip");
+    const char *etag = gz ? f->gz_etag : f->etag;
+    char extra[192];
+    snprintf(extra, sizeof(extra),
+             "ETag: %s\r\nCache-Control: public, max-age=60\r\n%s%s",
+             etag, f->gz_fd >= 0 ? "Vary: Accept-Encoding\r\n" : "",
+             gz ? "Content-Encoding: gzip\r\n" : "");
+    c->body_len = 0;
+    if (req_header(c, "If-None-Match", &v) && slice_has_token(v, etag)) {
+        response_head(c, 304, extra, NULL, 0);
+    } else {
+        size_t size = gz ? f->gz_size : f->size;
+        response_head(c, 200, extra, f->type, size);
+        if (!head) {
+            c->file_fd = gz ? f->gz_fd : f->fd;
+            c->file_len = size;
+        }
+    }
+    conn_start_write(c);
+    return true;
+}
+
+// ---------- status cache ----------
+
+// Rendered status JSON and CBOR, used only on the reactor thread. A
+// module's entry is redrawn the first time it is asked for after its
+// status version moves; /api/status/all is assembled from the entries
+// once per hub state version. Every other status request is a memcpy of
+// cached bytes.
+static StatusCacheEntry g_status_cache[HUB_MAX_DOORS];
+static bool     g_status_all_valid = false;
+static uint64_t g_status_all_version = 0;
+static size_t   g_status_all_len = 0;
+static char     g_status_all[64 + HUB_MAX_DOORS * (HTTP_STATUS_JSON_MAX + 1)];
+static size_t   g_status_all_cbor_len = 0;
+static uint8_t  g_status_all_cbor[32 + HUB_MAX_DOORS * HTTP_STATUS_CBOR_MAX];
+
+// The id and heartbeat line come off the network, so both are escaped.
+static size_t format_status(const HubDoorStatus *st, char *out, size_t size)
+{
+    // Escaping can grow a control byte to six characters.
+    char id[6 * HUB_MODULE_ID_LEN], line[6 * HUB_LINE_LEN];
+    json_escape(id, sizeof(id), st->module_id);
+    json_escape(line, sizeof(line), st->last_heartbeat_line);
+    // Include friendly field names for UI: front_door_open and front_lock_locked
+    int n = snprintf(out, size, "{\"module\":\"%s\",\"d0_open\":%s,\"d0_locked\":%s,\"d1_open\":%s,\"d1_locked\":%s,\"front_door_open\":%s,\"front_lock_locked\":%s,\"lastHB\":%lld,\"lastHBLine\":\"%s\"}",
+                     id,
+                     st->d0_open ? "true" : "false",
+                     st->d0_locked ? "true" : "false",
+                     st->d1_open ? "true" : "false",
+                     st->d1_locked ? "true" : "false",
+                     st->d0_open ? "true" : "false",
+                     st->d1_locked ? "true" : "false",
+                     st->last_heartbeat_ms,
+                     line);
+    return (n < 0) ? 0 : ((size_t)n < size ? (size_t)n : size - 1);
+}
+
+// The same fields as format_status(). Returns 0 if they do not fit.
+static size_t format_status_cbor(const HubDoorStatus *st, uint8_t *out, size_t size)
+{
+    CborOut o = { out, size, 0 };
+    cbor_map(&o, 9);
+    cbor_kv_text(&o, "module", st->module_id);
+    cbor_kv_bool(&o, "d0_open", st->d0_open);
+    cbor_kv_bool(&o, "d0_locked", st->d0_locked);
+    cbor_kv_bool(&o, "d1_open", st->d1_open);
+    cbor_kv_bool(&o, "d1_locked", st->d1_locked);
+    cbor_kv_bool(&o, "front_door_open", st->d0_open);
+    cbor_kv_bool(&o, "front_lock_locked", st->d1_locked);
+    cbor_kv_int(&o, "lastHB", st->last_heartbeat_ms);
+    cbor_kv_text(&o, "lastHBLine", st->last_heartbeat_line);
+    return o.len <= o.cap ? o.len : 0;
+}
+
+// The entry for `module_id`, or the one to reuse for it.
+static StatusCacheEntry *status_cache_slot(const char *module_id)
+{
+    StatusCacheEntry *victim = &g_status_cache[0];
+    for (int i = 0; i < HUB_MAX_DOORS; i++) {
+        StatusCacheEntry *e = &g_status_cache[i];
+        if (e->version && strcmp(e->module_id, module_id) == 0) return e;
+        if (e->version < victim->version) victim = e;
+    }
+    return victim;
+}
+
+static const StatusCacheEntry *status_render(const HubDoorStatus *st)
+{
+    StatusCacheEntry *e = status_cache_slot(st->module_id);
+    if (e->version != st->version || strcmp(e->module_id, st->module_id) != 0) {
+        snprintf(e->module_id, sizeof(e->module_id), "%s", st->module_id);
+        e->len = format_status(st, e->json, sizeof(e->json));
+        e->cbor_len = format_status_cbor(st, e->cbor, sizeof(e->cbor));
+        e->version = st->version;
+    }
+    return e;
+}
+
+// Cached JSON for a module the hub knows, or NULL.
+static const StatusCacheEntry *status_lookup(const char *module_id)
+{
+    uint64_t version = hub_udp_status_version(module_id);
+    if (version == 0) return NULL;
+    const StatusCacheEntry *e = status_cache_slot(module_id);
+    if (e->version == version && strcmp(e->module_id, module_id) == 0) return e;
+
+    HubDoorStatus st;
+    if (!hub_udp_get_status(module_id, &st)) return NULL;
+    return status_render(&st);
+}
+
+// ---------- request routing ----------
+
+// The CBOR representation gets its own ETag.
+static void make_etag(uint64_t version, bool cbor, char *out, size_t size)
+{
+    snprintf(out, size, "\"%llx-%llu%s\"", (unsigned long long)g_etag_epoch,
+             (unsigned long long)version, cbor ? "-cbor" : "");
+}
+
+// GET /api/status/all: every known module in one response. The ETag is
+// the hub state version, so a poll with a current If-None-Match is
+// answered 304 without copying or formatting anything; otherwise the body
+// comes from the status cache.
+static void handle_status_all(HttpConn *c)
+{
+    char etag[48];
+    char extra[96];
+    HttpSlice inm;
+    if (req_header(c, "If-None-Match", &inm)) {
+        make_etag(hub_udp_state_version(), c->cbor, etag, sizeof(etag));
+        if (slice_has_token(inm, etag) || slice_eq(inm, "*")) {
+            snprintf(extra, sizeof(extra),
+                     "ETag: %s\r\nCache-Control: no-cache\r\nVary: Accept\r\n", etag);
+            set_response_ex(c, 304, extra, NULL, 0);
+            conn_start_write(c);
+            return;
+        }
+    }
+
+    if (!g_status_all_valid || g_status_all_version != hub_udp_state_version()) {
+        HubDoorStatus doors[HUB_MAX_DOORS];
+        uint64_t version = 0;
+        int n = hub_udp_get_all_status(doors, HUB_MAX_DOORS, &version);
+
+        char *out = g_status_all;
+        size_t len = (size_t)snprintf(out, sizeof(g_status_all),
+                                      "{\"version\":%llu,\"modules\":[",
+                                      (unsigned long long)version);
+        CborOut o = { g_status_all_cbor, sizeof(g_status_all_cbor), 0 };
+        cbor_map(&o, 2);
+        cbor_kv_uint(&o, "version", version);
+        cbor_text(&o, "modules");
+        cbor_array(&o, (size_t)n);
+        for (int i = 0; i < n; i++) {
+            const StatusCacheEntry *e = status_render(&doors[i]);
+            if (i > 0) out[len++] = ',';
+            memcpy(out + len, e->json, e->len);
+            len += e->len;
+            // keep the declared item count: a module too big to encode is null
+            if (e->cbor_len) cbor_put(&o, e->cbor, e->cbor_len);
+            else cbor_null(&o);
+        }
+        out[len++] = ']';
+        out[len++] = '}';
+        g_status_all_len = len;
+        g_status_all_cbor_len = o.len;
+        g_status_all_version = version;
+        g_status_all_valid = true;
+    }
+
+    make_etag(g_status_all_version, c->cbor, etag, sizeof(etag));
+    snprintf(extra, sizeof(extra),
+             "ETag: %s\r\nCache-Control: no-cache\r\nVary: Accept\r\n", etag);
+    if (c->cbor) {
+        set_response_body(c, 200, extra, "application/cbor", g_status_all_cbor,
+                          g_status_all_cbor_len);
+    } else {
+        set_response_ex(c, 200, extra, g_status_all, g_status_all_len);
+    }
+    conn_start_write(c);
+}
+
+// Serializes matching history entries into a response body.
+typedef struct {
+    HttpConn *c;
+    CborOut  *cbor;             // set for Accept: application/cbor
+    int       limit;
+    int       count;
+    uint64_t  last_seq;
+    bool      more;
+} HistoryPage;
+
+static bool history_append(const HubEvent *e, void *ctx)
+{
+    HistoryPage *pg = ctx;
+    if (pg->count == pg->limit) {
+        pg->more = true;
+        return false;
+    }
+    HttpConn *c = pg->c;
+    const char *name = hub_bus_type_name((HubEventType)e->type);
+    pg->count++;
+    pg->last_seq = e->seq;
+    if (pg->cbor) {
+        cbor_map(pg->cbor, 5);
+        cbor_kv_uint(pg->cbor, "seq", e->seq);
+        cbor_kv_int(pg->cbor, "ts", e->timestamp_ms);
+        cbor_kv_text(pg->cbor, "module", e->module_id);
+        cbor_kv_text(pg->cbor, "type", name);
+        cbor_kv_text(pg->cbor, "line", e->line);
+        return true;
+    }
+    char id[6 * HUB_MODULE_ID_LEN], line[2 * HUB_LINE_LEN];
+    json_escape(id, sizeof(id), e->module_id);
+    if (json_escape(line, sizeof(line), e->line) < 0) line[0] = '\0';
+    // The body was reserved for `limit` entries of at most this size.
+    c->body_len += (size_t)snprintf(c->body + c->body_len, c->body_cap - c->body_len,
+                                    "%s{\"seq\":%llu,\"ts\":%lld,\"module\":\"%s\","
+                                    "\"type\":\"%s\",\"line\":\"%s\"}",
+                                    pg->count > 1 ? "," : "",
+                                    (unsigned long long)e->seq, e->timestamp_ms,
+                                    id, name, line);
+    return true;
+}
+
+// GET /api/history?module=D1&type=door,lock&since_seq=N&limit=N
+// Entries after since_seq, oldest first. `next_since_seq` is the cursor for
+// the following page (or the next poll once `more` is false).
+static void handle_history(HttpConn *c)
+{
+    HttpSlice v;
+    unsigned long long since = 0, limit = HTTP_HISTORY_DEFAULT;
+    uint32_t mask = 0;
+    c->mod[0] = '\0';
+    if (query_value(c, "module", &v)) slice_copy(c->mod, sizeof(c->mod), v);
+    if ((query_value(c, "since_seq", &v) && !slice_to_u64(v, &since)) ||
+        (query_value(c, "limit", &v) && (!slice_to_u64(v, &limit) || limit == 0)) ||
+        (query_value(c, "type", &v) && (mask = parse_type_list(v)) == 0)) {
+        set_response_status(c, 400, "{\"error\":\"bad query\"}");
+        conn_start_write(c);
+        return;
+    }
+    if (limit > HUB_MAX_HISTORY) limit = HUB_MAX_HISTORY;
+
+    // An entry is under 128 bytes of JSON plus its escaped module, type and
+    // escaped line.
+    size_t per_entry = 128 + 6 * HUB_MODULE_ID_LEN + 16 + 2 * HUB_LINE_LEN;
+    if (!body_reserve(c, 128 + (size_t)limit * per_entry)) {
+        set_response_status(c, 503, "{\"error\":\"no memory\"}");
+        conn_start_write(c);
+        return;
+    }
+    HistoryPage pg = { .c = c, .limit = (int)limit };
+    uint64_t newest = 0;
+    if (c->cbor) {
+        // {"events":[...],"next_since_seq":N,"more":bool}, the events as
+        // an indefinite-length array.
+        CborOut o = { (uint8_t *)c->body, c->body_cap, 0 };
+        pg.cbor = &o;
+        cbor_map(&o, 3);
+        cbor_text(&o, "events");
+        cbor_array_open(&o);
+        hub_udp_visit_history(c->mod, mask, since, history_append, &pg, &newest);
+        cbor_break(&o);
+        cbor_kv_uint(&o, "next_since_seq", pg.more ? pg.last_seq : newest);
+        cbor_kv_bool(&o, "more", pg.more);
+        set_response_cbor(c, 200, "Cache-Control: no-cache\r\n", &o);
+        conn_start_write(c);
+        return;
+    }
+    c->body_len = (size_t)snprintf(c->body, c->body_cap, "{\"events\":[");
+    hub_udp_visit_history(c->mod, mask, since, history_append, &pg, &newest);
+    c->body_len += (size_t)snprintf(c->body + c->body_len, c->body_cap - c->body_len,
+                                    "],\"next_since_seq\":%llu,\"more\":%s}",
+                                    (unsigned long long)(pg.more ? pg.last_seq : newest),
+                                    pg.more ? "true" : "false");
+    set_response_head(c, 200, "Cache-Control: no-cache\r\n");
+    conn_start_write(c);
+}
+
+// Form-encoded: module=D1&target=D0&action=LOCK[&id=...]
+static void parse_command_body(HttpConn *c, HttpSlice body)
+{
+    HttpSlice v;
+    if (form_value(body, "module", &v)) slice_copy(c->mod, sizeof(c->mod), v);
+    if (form_value(body, "target", &v)) slice_copy(c->target, sizeof(c->target), v);
+    if (form_value(body, "action", &v)) slice_copy(c->action, sizeof(c->action), v);
+    if (form_value(body, "id", &v))     slice_copy(c->tag, sizeof(c->tag), v);
+}
+
+// {"result":"failed","reason":...} in the format the request asked for.
+static void set_command_failed(HttpConn *c, int status_code, const char *reason)
+{
+    if (c->cbor) {
+        uint8_t buf[64];
+        CborOut o = { buf, sizeof(buf), 0 };
+        cbor_map(&o, 2);
+        cbor_kv_text(&o, "result", "failed");
+        cbor_kv_text(&o, "reason", reason);
+        set_response_cbor(c, status_code, NULL, &o);
+        return;
+    }
+    char out[96];
+    int n = snprintf(out, sizeof(out), "{\"result\":\"failed\",\"reason\":\"%s\"}", reason);
+    set_response_ex(c, status_code, NULL, out, (size_t)n);
+}
+
+// Runs on a worker: the batch's commands for the hub's own module, one
+// after the other (they share the motor).
+static void batch_run_local(HttpConn *c)
+{
+    HttpBatch *b = c->batch;
+    for (int i = 0; i < b->count; i++) {
+        HttpBatchItem *it = &b->items[i];
+        if (!it->local || it->done) continue;
+        char out[256];
+        run_local_command(it->action, out, sizeof(out));
+        // Keep the object's members, without the braces.
+        size_t len = strlen(out);
+        snprintf(it->fields, sizeof(it->fields), "%.*s", (int)(len - 2), out + 1);
+        it->ms = now_ms() - b->start_ms;
+        it->done = true;
+    }
+}
+
+// Prepare the batch's response with every item's result; items still
+// pending with the hub are reported as timed out.
+static void batch_finish(HttpConn *c)
+{
+    HttpBatch *b = c->batch;
+    long long now = now_ms();
+    size_t cap = 64 + (size_t)b->count * (sizeof(b->items[0].fields) + 256);
+    char *out = malloc(cap);
+    if (!out) {
+        set_response_status(c, 503, "{\"error\":\"no memory\"}");
+    } else {
+        size_t len = (size_t)snprintf(out, cap, "{\"ms\":%lld,\"results\":[",
+                                      now - b->start_ms);
+        for (int i = 0; i < b->count; i++) {
+            HttpBatchItem *it = &b->items[i];
+            if (!it->done) {
+                snprintf(it->fields, sizeof(it->fields),
+                         "\"result\":\"failed\",\"reason\":\"timeout\"");
+                it->ms = now - b->start_ms;
+            }
+            char mod[2 * HUB_MODULE_ID_LEN], target[64], action[64], tag[64];
+            if (json_escape(mod, sizeof(mod), it->mod) < 0) mod[0] = '\0';
+            if (json_escape(target, sizeof(target), it->target) < 0) target[0] = '\0';
+            if (json_escape(action, sizeof(action), it->action) < 0) action[0] = '\0';
+            if (json_escape(tag, sizeof(tag), it->tag) < 0) tag[0] = '\0';
+            len += (size_t)snprintf(out + len, cap - len,
+                                    "%s{\"id\":\"%s\",\"module\":\"%s\",\"target\":\"%s\","
+                                    "\"action\":\"%s\",\"ms\":%lld,%s}",
+                                    i ? "," : "", tag, mod, target, action, it->ms,
+                                    it->fields);
+        }
+        len += (size_t)snprintf(out + len, cap - len, "]}");
+        set_response_ex(c, 200, NULL, out, len);
+        free(out);
+    }
+    free(c->batch);
+    c->batch = NULL;
+}
+
+// Back from the worker: wait for the hub's results, if any are left.
+static void batch_job_done(HttpConn *c)
+{
+    if (c->batch->pending == 0) {
+        batch_finish(c);
+        conn_respond(c);
+        return;
+    }
+    c->state = CONN_PARKED;
+    c->deadline_ms = now_ms() + HTTP_PARK_TIMEOUT_MS;
+}
 
-// very small helper to send an HTTP response
-static void send_response_status(int client, int status_code, const char *body)
-{
-    char header[256];
-    int len = strlen(body);
-    const char *status_text = "OK";
-    if (status_code == 401) status_text = "Unauthorized";
-    else if (status_code == 400) status_text = "Bad Request";
-    else if (status_code == 404) status_text = "Not Found";
-    int hlen = snprintf(header, sizeof(header),
-                        "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %d\r\n\r\n",
-                        status_code, status_text, len);
-    send(client, header, hlen, 0);
-    send(client, body, len, 0);
-}
-
-static void send_response(int client, const char *body)
-{
-    send_response_status(client, 200, body);
-}
-
-// Find a header value (case-insensitive) in the raw request buffer.
-static char *get_header_value_from_request(const char *req, const char *key)
-{
-    const char *p = strstr(req, "\r\n");
-    if (!p) return NULL;
-    p += 2; // skip request-line CRLF
-    while (p && *p && !(p[0] == '\r' && p[1] == '\n')) {
-        const char *line_end = strstr(p, "\r\n");
-        if (!line_end) break;
-        // find ':'
-        const char *col = memchr(p, ':', (size_t)(line_end - p));
-        if (col) {
-            size_t klen = (size_t)(col - p);
-            // trim spaces
-            while (klen > 0 && p[klen-1] == ' ') klen--;
-            if (klen == strlen(key) && strncasecmp(p, key, klen) == 0) {
-                // value starts after ':' possibly space
-                const char *val = col + 1;
-                while (*val == ' ') val++;
-                size_t vlen = (size_t)(line_end - val);
-                char *res = malloc(vlen + 1);
-                if (!res) return NULL;
-                memcpy(res, val, vlen);
-                res[vlen] = '\0';
-                return res;
+// Deliver a command result to the batch that submitted it.
+static bool batch_on_result(const HubBusEvent *ev)
+{
+    for (int i = 0; i < HTTP_MAX_CONNS; i++) {
+        HttpConn *c = &g_conns[i];
+        HttpBatch *b = c->batch;
+        if (!b) continue;
+        for (int k = 0; k < b->count; k++) {
+            HttpBatchItem *it = &b->items[k];
+            if (it->done || it->local || it->cmdid != ev->cmdid ||
+                strcmp(it->mod, ev->module_id) != 0) {
+                continue;
+            }
+            if (ev->state) {
+                snprintf(it->fields, sizeof(it->fields),
+                         "\"result\":\"ok\",\"ack\":true,\"cmdid\":%d,\"rtt_ms\":%d",
+                         ev->cmdid, ev->rtt_ms);
+            } else {
+                snprintf(it->fields, sizeof(it->fields),
+                         "\"result\":\"failed\",\"reason\":\"%s\",\"cmdid\":%d",
+                         result_reason(ev), ev->cmdid);
+            }
+            it->ms = now_ms() - b->start_ms;
+            it->done = true;
+            // A batch still running its local commands answers when the
+            // worker is done.
+            if (--b->pending == 0 && c->state == CONN_PARKED) {
+                batch_finish(c);
+                conn_respond(c);
             }
+            return true;
         }
-        p = line_end + 2;
     }
-    return NULL;
+    return false;
 }
 
-// parse query param value for key from path like /api/status?module=D1
-static char *get_query_value(const char *path, const char *key)
-{
-    const char *q = strchr(path, '?');
-    if (!q) return NULL;
-    q++; // skip ?
-    char *copy = strdup(q);
-    char *save = NULL;
-    char *tok = strtok_r(copy, "&", &save);
-    while (tok) {
-        char *eq = strchr(tok, '=');
-        if (eq) {
-            *eq = '\0';
-            char *k = tok; char *v = eq + 1;
-            if (strcmp(k, key) == 0) {
-                char *res = strdup(v);
-                free(copy);
-                return res;
-            }
+// POST /api/commands: one command per line, each in the POST /api/command
+// body format plus an optional id echoed in its result:
+//   module=D1&target=D0&action=LOCK&id=front
+//   module=D2&target=D0&action=LOCK&id=back
+// Every remote command is submitted to the hub at once, so the batch takes
+// about as long as its slowest command. Commands for the hub's own module
+// run on a worker meanwhile, in order.
+static void handle_batch(HttpConn *c)
+{
+    HttpBatch *b = calloc(1, sizeof(*b));
+    if (!b) {
+        set_response_status(c, 503, "{\"error\":\"no memory\"}");
+        conn_start_write(c);
+        return;
+    }
+    const char *p = c->req_body.p, *end = p + c->req_body.len;
+    while (p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        HttpSlice line = { p, (size_t)((nl ? nl : end) - p) };
+        p = nl ? nl + 1 : end;
+        if (line.len && line.p[line.len - 1] == '\r') line.len--;
+        if (line.len == 0) continue;
+        if (b->count == HTTP_BATCH_MAX) {
+            free(b);
+            set_response_status(c, 413, "{\"error\":\"too many commands\"}");
+            conn_start_write(c);
+            return;
+        }
+        HttpBatchItem *it = &b->items[b->count++];
+        c->mod[0] = c->target[0] = c->action[0] = c->tag[0] = '\0';
+        parse_command_body(c, line);
+        snprintf(it->mod, sizeof(it->mod), "%s", c->mod);
+        snprintf(it->target, sizeof(it->target), "%s", c->target);
+        snprintf(it->action, sizeof(it->action), "%s", c->action);
+        snprintf(it->tag, sizeof(it->tag), "%s", c->tag);
+        if (!it->mod[0] || !it->action[0]) {
+            // A malformed line rejects the batch before anything runs.
+            char out[64];
+            snprintf(out, sizeof(out), "{\"error\":\"missing fields\",\"line\":%d}", b->count);
+            free(b);
+            set_response_status(c, 400, out);
+            conn_start_write(c);
+            return;
         }
-        tok = strtok_r(NULL, "&", &save);
     }
-    free(copy);
-    return NULL;
+    if (b->count == 0) {
+        free(b);
+        set_response_status(c, 400, "{\"error\":\"no commands\"}");
+        conn_start_write(c);
+        return;
+    }
+
+    b->start_ms = now_ms();
+    bool any_local = false;
+    for (int i = 0; i < b->count; i++) {
+        HttpBatchItem *it = &b->items[i];
+        const char *reason = NULL;
+        HubDoorStatus st;
+        if (strcmp(it->mod, g_module_id) == 0) {
+            it->local = any_local = true;
+            continue;
+        } else if (!hub_udp_get_status(it->mod, &st)) {
+            reason = "unknown_module";
+        } else if (!st.has_last_addr) {
+            reason = "no_route";
+        } else if ((it->cmdid = hub_udp_submit_command(it->mod, it->target, it->action)) < 0) {
+            reason = "busy";
+        }
+        if (reason) {
+            snprintf(it->fields, sizeof(it->fields),
+                     "\"result\":\"failed\",\"reason\":\"%s\"", reason);
+            it->done = true;
+        } else {
+            b->pending++;
+        }
+    }
+
+    c->batch = b;
+    if (any_local) {
+        offload(c, JOB_BATCH_LOCAL);
+    } else if (b->pending == 0) {
+        batch_finish(c);
+        conn_start_write(c);
+    } else {
+        c->state = CONN_PARKED;
+        c->deadline_ms = now_ms() + HTTP_PARK_TIMEOUT_MS;
+        conn_watch(c, 0);
+    }
 }
 
-static void handle_client(int client)
+// Route a complete request. Either prepares a response, offloads the
+// connection to a worker, or parks it on a submitted command.
+static void dispatch(HttpConn *c)
 {
-    char buf[8192];
-    ssize_t rc = recv(client, buf, sizeof(buf)-1, 0);
-    if (rc <= 0) { close(client); return; }
-    buf[rc] = '\0';
+    // HTTP/1.1 is persistent unless the client says otherwise; 1.0 only on
+    // request. Stop after HTTP_MAX_REQUESTS or while shutting down.
+    HttpSlice conn_hdr;
+    bool has_conn = req_header(c, "Connection", &conn_hdr);
+    if (slice_eq(c->version, "HTTP/1.1")) {
+        c->keep_alive = !(has_conn && slice_has_token(conn_hdr, "close"));
+    } else {
+        c->keep_alive = has_conn && slice_has_token(conn_hdr, "keep-alive");
+    }
+    if (++c->served >= HTTP_MAX_REQUESTS || !server_running) {
+        c->keep_alive = false;
+    }
+
+    bool get = slice_eq(c->method, "GET");
+    bool post = slice_eq(c->method, "POST");
+    bool head = slice_eq(c->method, "HEAD");
+    c->cbor = accepts(c, "application/cbor");
 
-    // parse request line
-    char method[8] = {0};
-    char path[1024] = {0};
-    if (sscanf(buf, "%7s %1023s", method, path) < 2) {
-        close(client); return;
+    // The dashboard's files are public: a browser cannot add the API token
+    // to a page load.
+    if ((get || head) && g_static_count > 0 &&
+        !(c->path.len >= 5 && strncmp(c->path.p, "/api/", 5) == 0) &&
+        handle_static(c, head)) {
+        return;
     }
 
     // Simple API token enforcement: if HTTP_API_TOKEN is set, require
     // header `X-API-TOKEN: <token>` to match. If not set, allow access.
-    const char *expected_token = getenv("HTTP_API_TOKEN");
-    if (expected_token) {
-        char *got = get_header_value_from_request(buf, "X-API-TOKEN");
-        if (!got || strcmp(got, expected_token) != 0) {
-            send_response_status(client, 401, "{\"error\":\"unauthorized\"}");
-            free(got);
-            close(client);
+    if (g_api_token) {
+        HttpSlice got;
+        bool have = req_header(c, "X-API-TOKEN", &got);
+        // Browsers cannot add headers to a WebSocket handshake.
+        if (!have && route_is(c, "/api/ws")) have = query_value(c, "token", &got);
+        if (!have || !token_matches(got)) {
+            set_response_status(c, 401, "{\"error\":\"unauthorized\"}");
+            conn_start_write(c);
             return;
         }
-        free(got);
     }
 
-    if (strcmp(method, "GET") == 0 && strncmp(path, "/api/status", 11) == 0) {
-        char *mod = get_query_value(path, "module");
-        if (!mod) {
-            send_response(client, "{\"error\":\"missing module\"}");
-            free(mod);
-            close(client);
+    if (get && route_is(c, "/api/events")) {
+        handle_events(c);
+        return;
+    }
+
+    if (get && route_is(c, "/api/ws")) {
+        handle_ws(c);
+        return;
+    }
+
+    if (get && route_is(c, "/api/history/export")) {
+        handle_history_export(c);
+        return;
+    }
+
+    if (get && route_is(c, "/api/history")) {
+        handle_history(c);
+        return;
+    }
+
+    if (get && route_is(c, "/api/status/all")) {
+        handle_status_all(c);
+        return;
+    }
+
+    if (get && route_is(c, "/api/status")) {
+        HttpSlice mod;
+        if (!query_value(c, "module", &mod)) {
+            set_response(c, "{\"error\":\"missing module\"}");
+            conn_start_write(c);
             return;
         }
+        slice_copy(c->mod, sizeof(c->mod), mod);
+
         // prefer hub status; fallback to local status if module == local
-        HubDoorStatus st;
-        if (hub_udp_get_status(mod, &st)) {
-            char out[512];
-            // Include friendly field names for UI: front_door_open and front_lock_locked
-            snprintf(out, sizeof(out), "{\"module\":\"%s\",\"d0_open\":%s,\"d0_locked\":%s,\"d1_open\":%s,\"d1_locked\":%s,\"front_door_open\":%s,\"front_lock_locked\":%s,\"lastHB\":%lld,\"lastHBLine\":\"%s\"}",
-                     st.module_id,
-                     st.d0_open ? "true" : "false",
-                     st.d0_locked ? "true" : "false",
-                     st.d1_open ? "true" : "false",
-                     st.d1_locked ? "true" : "false",
-                     st.d0_open ? "true" : "false",
-                     st.d1_locked ? "true" : "false",
-                     st.last_heartbeat_ms,
-                     st.last_heartbeat_line);
-            send_response(client, out);
-            free(mod);
-            close(client);
+        const StatusCacheEntry *cached = status_lookup(c->mod);
+        if (cached && c->cbor) {
+            set_response_body(c, 200, NULL, "application/cbor", cached->cbor,
+                              cached->cbor_len);
+            conn_start_write(c);
+            return;
+        }
+        if (cached) {
+            set_response_ex(c, 200, NULL, cached->json, cached->len);
+            conn_start_write(c);
             return;
         }
 
-        // if module equals local, use direct get_door_status
-        if (strcmp(mod, g_module_id) == 0) {
-            Door_t d = { .state = UNKNOWN };
-            d = get_door_status(&d);
-            // Map Door_t state to friendly booleans for front door and lock
-            const char *front_open = (d.state == OPEN) ? "true" : "false";
-            const char *front_locked = (d.state == LOCKED) ? "true" : "false";
-            char out[256];
-            snprintf(out, sizeof(out), "{\"module\":\"%s\",\"state\":%d,\"front_door_open\":%s,\"front_lock_locked\":%s}",
-                     mod, d.state, front_open, front_locked);
-            send_response(client, out);
-            free(mod);
-            close(client);
+        // if module equals local, read the sensor on a worker
+        if (strcmp(c->mod, g_module_id) == 0) {
+            offload(c, JOB_LOCAL_STATUS);
             return;
         }
 
-        send_response(client, "{\"error\":\"no status\"}");
-        free(mod);
-        close(client);
-        return;
-    }
-
-    if (strcmp(method, "POST") == 0 && strcmp(path, "/api/command") == 0) {
-        // find body (very small/simple parser)
-        char *body = strstr(buf, "\r\n\r\n");
-        if (!body) { send_response(client, "{\"error\":\"no body\"}"); close(client); return; }
-        body += 4;
-        // expect form-encoded: module=D1&target=D0&action=LOCK
-        char *mod = NULL; char *target = NULL; char *action = NULL;
-        char *bcopy = strdup(body);
-        char *save = NULL;
-        char *tok = strtok_r(bcopy, "&", &save);
-        while (tok) {
-            char *eq = strchr(tok, '=');
-            if (eq) {
-                *eq = '\0';
-                char *k = tok; char *v = eq + 1;
-                if (strcmp(k, "module") == 0) mod = strdup(v);
-                else if (strcmp(k, "target") == 0) target = strdup(v);
-                else if (strcmp(k, "action") == 0) action = strdup(v);
-            }
-            tok = strtok_r(NULL, "&", &save);
+        set_response(c, "{\"error\":\"no status\"}");
+        conn_start_write(c);
+        return;
+    }
+
+    if (get && c->path.len > 13 && strncmp(c->path.p, "/api/command/", 13) == 0) {
+        handle_command_status(c, (HttpSlice){ c->path.p + 13, c->path.len - 13 });
+        return;
+    }
+
+    if (post && route_is(c, "/api/commands")) {
+        if (c->req_body.len == 0) {
+            set_response_status(c, 400, "{\"error\":\"no body\"}");
+            conn_start_write(c);
+            return;
+        }
+        handle_batch(c);
+        return;
+    }
+
+    if (post && route_is(c, "/api/command")) {
+        if (c->req_body.len == 0) {
+            set_response(c, "{\"error\":\"no body\"}");
+            conn_start_write(c);
+            return;
         }
-        free(bcopy);
+        parse_command_body(c, c->req_body);
 
-        if (!mod || !action) {
-            send_response(client, "{\"error\":\"missing fields\"}");
-            free(mod); free(target); free(action);
-            close(client); return;
+        if (!c->mod[0] || !c->action[0]) {
+            set_response(c, "{\"error\":\"missing fields\"}");
+            conn_start_write(c);
+            return;
         }
 
-        // If target module is local, perform directly
-        if (strcmp(mod, g_module_id) == 0) {
-            Door_t d = { .state = UNKNOWN };
-            if (strcmp(action, "LOCK") == 0) {
-                d = lockDoor(&d);
-            } else if (strcmp(action, "UNLOCK") == 0) {
-                d = unlockDoor(&d);
-            } else if (strcmp(action, "STATUS") == 0) {
-                d = get_door_status(&d);
-            } else {
-                send_response(client, "{\"error\":\"unknown action\"}");
-                free(mod); free(target); free(action);
-                close(client); return;
-            }
-            char out[256];
-            snprintf(out, sizeof(out), "{\"result\":\"ok\",\"state\":%d}", d.state);
-            send_response(client, out);
-            free(mod); free(target); free(action);
-            close(client); return;
+        // Asynchronous submission: ?async=1 or "Prefer: respond-async".
+        HttpSlice v;
+        bool async = query_value(c, "async", &v) && !slice_eq(v, "0");
+        bool prefer_async = req_header(c, "Prefer", &v) &&
+                            slice_has_token(v, "respond-async");
+        async = async || prefer_async;
+
+        // If target module is local, perform directly (on a worker). Local
+        // commands are answered when done even in asynchronous mode.
+        if (strcmp(c->mod, g_module_id) == 0) {
+            offload(c, JOB_LOCAL_COMMAND);
+            return;
         }
 
         // Otherwise: forward command to hub which will deliver to the door.
         // First check that the hub has a route to the module.
         HubDoorStatus st;
-        if (!hub_udp_get_status(mod, &st)) {
-            send_response(client, "{\"result\":\"failed\",\"reason\":\"unknown_module\"}");
-            free(mod); free(target); free(action);
-            close(client); return;
+        if (!hub_udp_get_status(c->mod, &st)) {
+            set_command_failed(c, 200, "unknown_module");
+            conn_start_write(c);
+            return;
         }
         if (!st.has_last_addr) {
-            send_response(client, "{\"result\":\"failed\",\"reason\":\"no_route\"}");
-            free(mod); free(target); free(action);
-            close(client); return;
+            set_command_failed(c, 200, "no_route");
+            conn_start_write(c);
+            return;
         }
 
-        // Send command and wait for ACK (hub_udp_send_command blocks until ACK or timeout)
-        bool sent = hub_udp_send_command(mod, target ? target : "", action);
-        if (sent) {
-            // refresh status to include the latest FEEDBACK fields
-            if (!hub_udp_get_status(mod, &st)) {
-                send_response(client, "{\"result\":\"ok\",\"ack\":true}");
+        // Submit without waiting; the result arrives on the bus.
+        int cmdid = hub_udp_submit_command(c->mod, c->target, c->action);
+        if (cmdid < 0) {
+            set_command_failed(c, 503, "busy");
+            conn_start_write(c);
+            return;
+        }
+        if (async) {
+            cmd_record_add(c, cmdid);
+            char location[32], extra[128];
+            snprintf(location, sizeof(location), "/api/command/%d", cmdid);
+            snprintf(extra, sizeof(extra), "Location: %s\r\n%s", location,
+                     prefer_async ? "Preference-Applied: respond-async\r\n" : "");
+            if (c->cbor) {
+                uint8_t buf[96];
+                CborOut o = { buf, sizeof(buf), 0 };
+                cbor_map(&o, 3);
+                cbor_kv_text(&o, "result", "accepted");
+                cbor_kv_int(&o, "cmdid", cmdid);
+                cbor_kv_text(&o, "status", location);
+                set_response_cbor(c, 202, extra, &o);
             } else {
-                char out[512];
-                snprintf(out, sizeof(out), "{\"result\":\"ok\",\"ack\":true,\"last_feedback_target\":\"%s\",\"last_feedback_action\":\"%s\",\"last_feedback_ms\":%lld}",
-                         st.last_feedback_target, st.last_feedback_action, st.last_feedback_ms);
-                send_response(client, out);
+                char out[96];
+                int n = snprintf(out, sizeof(out),
+                                 "{\"result\":\"accepted\",\"cmdid\":%d,\"status\":\"%s\"}",
+                                 cmdid, location);
+                set_response_ex(c, 202, extra, out, (size_t)n);
             }
+            conn_start_write(c);
+            return;
+        }
+        c->cmdid = cmdid;
+        c->state = CONN_PARKED;
+        c->deadline_ms = now_ms() + HTTP_PARK_TIMEOUT_MS;
+        conn_watch(c, 0);
+        return;
+    }
+
+    set_response(c, "{\"error\":\"unknown endpoint\"}");
+    conn_start_write(c);
+}
+
+// Record or deliver a command result: to the async table, a WebSocket, or
+// the request parked on `ev->cmdid`.
+static void on_command_result(const HubBusEvent *ev)
+{
+    cmd_record_result(ev);
+    if (ws_on_result(ev)) return;
+    if (batch_on_result(ev)) return;
+    for (int i = 0; i < HTTP_MAX_CONNS; i++) {
+        HttpConn *c = &g_conns[i];
+        if (c->state != CONN_PARKED || c->cmdid != ev->cmdid ||
+            strcmp(c->mod, ev->module_id) != 0) {
+            continue;
+        }
+        // The FEEDBACK fields are the ones that answered this cmdid.
+        if (!ev->state) {
+            set_command_failed(c, 200, result_reason(ev));
+        } else if (c->cbor) {
+            uint8_t buf[256];
+            CborOut o = { buf, sizeof(buf), 0 };
+            cbor_map(&o, 6);
+            cbor_kv_text(&o, "result", "ok");
+            cbor_kv_bool(&o, "ack", true);
+            cbor_kv_text(&o, "last_feedback_target", ev->target);
+            cbor_kv_text(&o, "last_feedback_action", ev->feedback);
+            cbor_kv_int(&o, "last_feedback_ms", ev->timestamp_ms);
+            cbor_kv_int(&o, "rtt_ms", ev->rtt_ms);
+            set_response_cbor(c, 200, NULL, &o);
         } else {
-            send_response(client, "{\"result\":\"failed\",\"reason\":\"no_ack\"}");
+            char target[6 * 32], feedback[6 * 32];
+            json_escape(target, sizeof(target), ev->target);
+            json_escape(feedback, sizeof(feedback), ev->feedback);
+            char out[512];
+            snprintf(out, sizeof(out), "{\"result\":\"ok\",\"ack\":true,\"last_feedback_target\":\"%s\",\"last_feedback_action\":\"%s\",\"last_feedback_ms\":%lld,\"rtt_ms\":%d}",
+                     target, feedback, ev->timestamp_ms, ev->rtt_ms);
+            set_response(c, out);
+        }
+        conn_respond(c);
+        return;
+    }
+}
+
+// ---------- WebSocket ----------
+
+static uint32_t rol32(uint32_t v, int n)
+{
+    return (v << n) | (v >> (32 - n));
+}
+
+// SHA-1, only for Sec-WebSocket-Accept.
+static void sha1(const unsigned char *data, size_t len, unsigned char out[20])
+{
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    uint64_t bits = (uint64_t)len * 8;
+    size_t total = ((len + 8) / 64 + 1) * 64;   // message + 0x80 + length
+    for (size_t off = 0; off < total; off += 64) {
+        unsigned char block[64];
+        for (size_t i = 0; i < 64; i++) {
+            size_t k = off + i;
+            if (k < len)               block[i] = data[k];
+            else if (k == len)         block[i] = 0x80;
+            else if (k >= total - 8)   block[i] = (unsigned char)(bits >> (8 * (total - 1 - k)));
+            else                       block[i] = 0;
+        }
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++) {
+            w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 |
+                   (uint32_t)block[4 * i + 2] << 8 | block[4 * i + 3];
+        }
+        for (int i = 16; i < 80; i++) {
+            w[i] = rol32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+            else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+            else             { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+            uint32_t t = rol32(a, 5) + f + e + k + w[i];
+            e = d; d = c; c = rol32(b, 30); b = a; a = t;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+    for (int i = 0; i < 5; i++) {
+        out[4 * i]     = (unsigned char)(h[i] >> 24);
+        out[4 * i + 1] = (unsigned char)(h[i] >> 16);
+        out[4 * i + 2] = (unsigned char)(h[i] >> 8);
+        out[4 * i + 3] = (unsigned char)h[i];
+    }
+}
+
+static void base64_encode(const unsigned char *in, size_t len, char *out)
+{
+    static const char tbl[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t o = 0;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = (uint32_t)in[i] << 16;
+        if (i + 1 < len) v |= (uint32_t)in[i + 1] << 8;
+        if (i + 2 < len) v |= in[i + 2];
+        out[o++] = tbl[(v >> 18) & 63];
+        out[o++] = tbl[(v >> 12) & 63];
+        out[o++] = (i + 1 < len) ? tbl[(v >> 6) & 63] : '=';
+        out[o++] = (i + 2 < len) ? tbl[v & 63] : '=';
+    }
+    out[o] = '\0';
+}
+
+// Queue one frame; results and control frames may use the reserve.
+static void ws_send(HttpConn *c, int opcode, const char *payload, size_t len)
+{
+    char frame[HTTP_WS_MAX_MSG + 4];
+    size_t n = ws_frame(frame, sizeof(frame), opcode, payload, len);
+    if (n == 0 || !stream_append(c, frame, n)) {
+        fprintf(stderr, "[http_api] WebSocket client buffer full; frame dropped\n");
+    }
+}
+
+// Send a close frame and drop the connection.
+static void ws_fail(HttpConn *c, int code)
+{
+    char p[2] = { (char)(code >> 8), (char)(code & 0xff) };
+    ws_send(c, WS_OP_CLOSE, p, sizeof(p));
+    stream_flush(c);
+    conn_close(c);
+}
+
+// {"type":"result","id":<tag>,"module":<mod>,<fields>}
+static void ws_reply(HttpConn *c, const char *tag, const char *mod,
+                     const char *fields)
+{
+    char etag[2 * sizeof(c->tag)], emod[2 * HUB_MODULE_ID_LEN];
+    if (json_escape(etag, sizeof(etag), tag) < 0) etag[0] = '\0';
+    if (json_escape(emod, sizeof(emod), mod) < 0) emod[0] = '\0';
+    char p[HTTP_WS_MAX_MSG];
+    int n = snprintf(p, sizeof(p), "{\"type\":\"result\",\"id\":\"%s\",\"module\":\"%s\",%s}",
+                     etag, emod, fields);
+    if (n > 0 && (size_t)n < sizeof(p)) ws_send(c, WS_OP_TEXT, p, (size_t)n);
+}
+
+// A text message is a command in the POST /api/command body format plus
+// an optional client id echoed in the result:
+//   module=D1&target=D0&action=LOCK&id=42
+// Returns false if the connection was handed to a worker.
+static bool ws_command(HttpConn *c, HttpSlice text)
+{
+    c->mod[0] = c->target[0] = c->action[0] = c->tag[0] = '\0';
+    parse_command_body(c, text);
+    if (!c->mod[0] || !c->action[0]) {
+        ws_reply(c, c->tag, c->mod, "\"result\":\"failed\",\"reason\":\"missing_fields\"");
+        return true;
+    }
+
+    // The hub's own module: run it on a worker and stop reading until the
+    // motor is done, so the connection's commands stay in order.
+    if (strcmp(c->mod, g_module_id) == 0) {
+        stream_flush(c);
+        offload(c, JOB_LOCAL_COMMAND);
+        return false;
+    }
+
+    HubDoorStatus st;
+    const char *reason = NULL;
+    int slot = -1;
+    for (int i = 0; i < HTTP_WS_MAX_CMDS && slot < 0; i++) {
+        if (c->ws_cmds[i].cmdid == 0) slot = i;
+    }
+    if (!hub_udp_get_status(c->mod, &st))  reason = "unknown_module";
+    else if (!st.has_last_addr)            reason = "no_route";
+    else if (slot < 0)                     reason = "busy";
+    int cmdid = reason ? -1 : hub_udp_submit_command(c->mod, c->target, c->action);
+    if (!reason && cmdid < 0) reason = "busy";
+    if (reason) {
+        char fields[64];
+        snprintf(fields, sizeof(fields), "\"result\":\"failed\",\"reason\":\"%s\"", reason);
+        ws_reply(c, c->tag, c->mod, fields);
+        return true;
+    }
+    c->ws_cmds[slot].cmdid = cmdid;
+    snprintf(c->ws_cmds[slot].mod, sizeof(c->ws_cmds[slot].mod), "%s", c->mod);
+    snprintf(c->ws_cmds[slot].tag, sizeof(c->ws_cmds[slot].tag), "%s", c->tag);
+    return true;
+}
+
+// Handle one complete frame (payload already unmasked). Returns false once
+// the connection has been closed or handed to a worker.
+static bool ws_message(HttpConn *c, bool fin, int opcode, char *data, size_t len)
+{
+    if (opcode & 0x8) {
+        if (!fin || len > 125) {
+            ws_fail(c, 1002);
+            return false;
         }
-        free(mod); free(target); free(action);
-        close(client); return;
+        if (opcode == WS_OP_CLOSE) {
+            // Echo the status code, then close our side too.
+            ws_send(c, WS_OP_CLOSE, data, len >= 2 ? 2 : 0);
+            stream_flush(c);
+            conn_close(c);
+            return false;
+        }
+        if (opcode == WS_OP_PING) ws_send(c, WS_OP_PONG, data, len);
+        return true;   // pongs answer our keepalive pings
+    }
+    // Commands are short text messages; fragmented or binary ones are not
+    // part of the protocol.
+    if (!fin || opcode != WS_OP_TEXT) {
+        ws_fail(c, 1003);
+        return false;
+    }
+    if (len >= HTTP_WS_MAX_MSG) {
+        ws_fail(c, 1009);
+        return false;
+    }
+    return ws_command(c, (HttpSlice){ data, len });
+}
+
+// Parse every complete frame in the input buffer. Returns true while the
+// connection is still a stream owned by the reactor.
+static bool ws_process(HttpConn *c)
+{
+    size_t off = 0;
+    while (c->state == CONN_STREAM) {
+        unsigned char *p = (unsigned char *)c->req + off;
+        size_t avail = c->req_len - off;
+        if (avail < 2) break;
+        // No extensions are negotiated, and clients must mask.
+        if ((p[0] & 0x70) || !(p[1] & 0x80)) {
+            ws_fail(c, 1002);
+            return false;
+        }
+        size_t len = p[1] & 0x7f;
+        size_t hdr = 6;
+        if (len == 126) {
+            if (avail < 4) break;
+            len = (size_t)p[2] << 8 | p[3];
+            hdr = 8;
+        }
+        if (len == 127 || hdr + len > HTTP_REQ_MAX - 1) {
+            ws_fail(c, 1009);
+            return false;
+        }
+        if (avail < hdr + len) break;
+
+        const unsigned char *mask = p + hdr - 4;
+        char *payload = (char *)p + hdr;
+        for (size_t i = 0; i < len; i++) payload[i] ^= (char)mask[i & 3];
+        off += hdr + len;
+        if (!ws_message(c, (p[0] & 0x80) != 0, p[0] & 0x0f, payload, len)) break;
+    }
+    if (c->state == CONN_FREE) return false;
+    memmove(c->req, c->req + off, c->req_len - off);
+    c->req_len -= off;
+    return c->state == CONN_STREAM;
+}
+
+static void ws_read(HttpConn *c)
+{
+    while (1) {
+        ssize_t n = recv(c->fd, c->req + c->req_len,
+                         HTTP_REQ_MAX - 1 - c->req_len, 0);
+        if (n > 0) {
+            c->req_len += (size_t)n;
+            if (!ws_process(c)) return;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        conn_close(c);
+        return;
+    }
+    stream_service(c);
+}
+
+// A local command finished on a worker: report it and resume reading.
+static void ws_job_done(HttpConn *c)
+{
+    // run_job() prepared an HTTP body ({"result":...} or {"error":...});
+    // its members become the result message's fields.
+    char fields[256] = "\"result\":\"failed\"";
+    if (c->body_len > 2 && c->body_len < sizeof(fields)) {
+        memcpy(fields, c->body + 1, c->body_len - 2);
+        fields[c->body_len - 2] = '\0';
+    }
+    c->state = CONN_STREAM;
+    ws_reply(c, c->tag, c->mod, fields);
+    if (ws_process(c)) stream_service(c);
+}
+
+// Deliver a command result to the WebSocket that issued it. Returns true
+// if one did.
+static bool ws_on_result(const HubBusEvent *ev)
+{
+    for (int i = 0; i < HTTP_MAX_CONNS; i++) {
+        HttpConn *c = &g_conns[i];
+        // A connection running a local command still collects results.
+        if (!c->ws || (c->state != CONN_STREAM && c->state != CONN_WORKING)) continue;
+        for (int k = 0; k < HTTP_WS_MAX_CMDS; k++) {
+            if (c->ws_cmds[k].cmdid != ev->cmdid ||
+                strcmp(c->ws_cmds[k].mod, ev->module_id) != 0) {
+                continue;
+            }
+            char fields[768];
+            if (!ev->state) {
+                snprintf(fields, sizeof(fields),
+                         "\"cmdid\":%d,\"result\":\"failed\",\"reason\":\"%s\"",
+                         ev->cmdid, result_reason(ev));
+            } else {
+                char target[6 * 32], action[6 * 32], feedback[6 * 32];
+                json_escape(target, sizeof(target), ev->target);
+                json_escape(action, sizeof(action), ev->action);
+                json_escape(feedback, sizeof(feedback), ev->feedback);
+                snprintf(fields, sizeof(fields),
+                         "\"cmdid\":%d,\"result\":\"ok\",\"ack\":true,\"target\":\"%s\","
+                         "\"action\":\"%s\",\"feedback\":\"%s\",\"rtt_ms\":%d",
+                         ev->cmdid, target, action, feedback, ev->rtt_ms);
+            }
+            ws_reply(c, c->ws_cmds[k].tag, c->ws_cmds[k].mod, fields);
+            c->ws_cmds[k].cmdid = 0;
+            if (c->state == CONN_STREAM) stream_service(c);
+            return true;
+        }
+    }
+    return false;
+}
+
+// GET /api/ws: upgrade to a WebSocket. Takes the same query parameters as
+// /api/events to select the event feed.
+static void handle_ws(HttpConn *c)
+{
+    HttpSlice upgrade, connection, key, version;
+    int status = 0;
+    if (!req_header(c, "Upgrade", &upgrade) || !slice_has_token(upgrade, "websocket") ||
+        !req_header(c, "Connection", &connection) ||
+        !slice_has_token(connection, "upgrade") ||
+        !req_header(c, "Sec-WebSocket-Key", &key) || key.len != 24) {
+        status = 400;
+    } else if (!req_header(c, "Sec-WebSocket-Version", &version) ||
+               !slice_eq(version, "13")) {
+        status = 426;
+    }
+
+    char accept[32] = "";
+    if (status == 0) {
+        static const char guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+        char buf[24 + sizeof(guid)];
+        unsigned char digest[20];
+        memcpy(buf, key.p, 24);
+        memcpy(buf + 24, guid, sizeof(guid));
+        sha1((const unsigned char *)buf, 24 + sizeof(guid) - 1, digest);
+        base64_encode(digest, sizeof(digest), accept);
+    }
+
+    if (status == 400) {
+        set_response_status(c, 400, "{\"error\":\"bad websocket handshake\"}");
+        conn_start_write(c);
+        return;
+    }
+    if (status == 426) {
+        static const char body[] = "{\"error\":\"unsupported websocket version\"}";
+        set_response_ex(c, 426, "Sec-WebSocket-Version: 13\r\n", body, sizeof(body) - 1);
+        conn_start_write(c);
+        return;
+    }
+
+    char head[160];
+    int n = snprintf(head, sizeof(head),
+                     "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+                     "Connection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n", accept);
+    c->ws = true;
+    // Frames are JSON text whatever the upgrade request accepted; local
+    // command jobs must not answer this connection in CBOR.
+    c->cbor = false;
+    if (!stream_open(c, head, (size_t)n)) return;
+
+    // Frames may have arrived together with the handshake.
+    size_t rest = c->req_len - c->req_total;
+    memmove(c->req, c->req + c->req_total, rest);
+    c->req_len = rest;
+    c->req_total = 0;
+    stream_service(c);
+    if (c->state == CONN_STREAM && c->req_len > 0 && ws_process(c)) {
+        stream_service(c);
+    }
+}
+
+// ---------- request parser ----------
+
+// Incremental and zero-copy: each read resumes at `scan`, complete lines
+// are split into slices of the request buffer as they arrive, and nothing
+// is copied or allocated per field.
+
+static int frame_error(HttpConn *c, int status_code, const char *body)
+{
+    // The rest of the stream cannot be framed either: close after replying.
+    c->keep_alive = false;
+    set_response_status(c, status_code, body);
+    return -1;
+}
+
+// METHOD SP request-target SP HTTP/1.x
+static bool parse_request_line(HttpConn *c, HttpSlice line)
+{
+    const char *sp1 = memchr(line.p, ' ', line.len);
+    if (!sp1 || sp1 == line.p) return false;
+    const char *rest = sp1 + 1;
+    size_t rest_len = line.len - (size_t)(rest - line.p);
+    const char *sp2 = memchr(rest, ' ', rest_len);
+    if (!sp2 || sp2 == rest) return false;
+
+    c->method  = (HttpSlice){ line.p, (size_t)(sp1 - line.p) };
+    c->version = (HttpSlice){ sp2 + 1, rest_len - (size_t)(sp2 + 1 - rest) };
+    if (c->version.len != 8 || strncmp(c->version.p, "HTTP/1.", 7) != 0) return false;
+
+    HttpSlice target = { rest, (size_t)(sp2 - rest) };
+    const char *q = memchr(target.p, '?', target.len);
+    if (q) {
+        c->path  = (HttpSlice){ target.p, (size_t)(q - target.p) };
+        c->query = (HttpSlice){ q + 1, target.len - c->path.len - 1 };
+    } else {
+        c->path  = target;
+        c->query = (HttpSlice){ NULL, 0 };
+    }
+    return true;
+}
+
+// name ":" OWS value OWS. Returns 0, or -1 with an error response prepared.
+static int parse_header_line(HttpConn *c, HttpSlice line)
+{
+    const char *colon = memchr(line.p, ':', line.len);
+    if (line.p[0] == ' ' || line.p[0] == '\t' || !colon || colon == line.p) {
+        return frame_error(c, 400, "{\"error\":\"bad request\"}");
+    }
+    if (c->num_hdrs == HTTP_MAX_HEADERS) {
+        return frame_error(c, 431, "{\"error\":\"too many headers\"}");
+    }
+    HttpSlice name = { line.p, (size_t)(colon - line.p) };
+    while (name.len > 0 && name.p[name.len - 1] == ' ') name.len--;
+    const char *v = colon + 1, *end = line.p + line.len;
+    while (v < end && (*v == ' ' || *v == '\t')) v++;
+    while (end > v && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    HttpSlice value = { v, (size_t)(end - v) };
+    c->hdrs[c->num_hdrs].name = name;
+    c->hdrs[c->num_hdrs].value = value;
+    c->num_hdrs++;
+
+    if (slice_ieq(name, "Transfer-Encoding")) {
+        return frame_error(c, 411, "{\"error\":\"content-length required\"}");
+    }
+    if (slice_ieq(name, "Content-Length")) {
+        unsigned long long n;
+        if (!slice_to_u64(value, &n) || (c->has_length && n != c->content_length)) {
+            return frame_error(c, 400, "{\"error\":\"bad content-length\"}");
+        }
+        if (n > HTTP_REQ_MAX) {
+            return frame_error(c, 413, "{\"error\":\"request too large\"}");
+        }
+        c->content_length = (size_t)n;
+        c->has_length = true;
+    }
+    return 0;
+}
+
+// Continue parsing the request at the start of `req`. Returns 1 and sets
+// req_total when the headers and Content-Length bytes of body are all
+// there, 0 if more bytes are needed, -1 (with an error response prepared)
+// if the request can never be framed.
+static int parse_request(HttpConn *c)
+{
+    while (c->parse != PARSE_BODY) {
+        const char *start = c->req + c->scan;
+        const char *nl = memchr(start, '\n', c->req_len - c->scan);
+        if (!nl) {
+            if (c->req_len < HTTP_REQ_MAX - 1) return 0;
+            return frame_error(c, 413, "{\"error\":\"request too large\"}");
+        }
+        HttpSlice line = { start, (size_t)(nl - start) };
+        if (line.len > 0 && line.p[line.len - 1] == '\r') line.len--;
+        c->scan = (size_t)(nl - c->req) + 1;
+
+        if (c->parse == PARSE_LINE) {
+            if (line.len == 0) continue;   // stray CRLF after a previous body
+            if (!parse_request_line(c, line)) {
+                return frame_error(c, 400, "{\"error\":\"bad request\"}");
+            }
+            c->parse = PARSE_HEADERS;
+        } else if (line.len == 0) {
+            c->body_off = c->scan;
+            if (c->content_length > HTTP_REQ_MAX - 1 - c->body_off) {
+                return frame_error(c, 413, "{\"error\":\"request too large\"}");
+            }
+            c->parse = PARSE_BODY;
+        } else if (parse_header_line(c, line) < 0) {
+            return -1;
+        }
+    }
+    if (c->req_len < c->body_off + c->content_length) return 0;
+    c->req_body = (HttpSlice){ c->req + c->body_off, c->content_length };
+    c->req_total = c->body_off + c->content_length;
+    return 1;
+}
+
+// ---------- reactor ----------
+
+// Dispatch buffered requests in order until one is handed to a worker or
+// parked, the buffer runs dry, or the connection is closed.
+static void process_buffered(HttpConn *c)
+{
+    while (c->state == CONN_READING && c->req_len > 0) {
+        int r = parse_request(c);
+        if (r == 0) return;
+        if (r < 0) {
+            conn_start_write(c);
+            return;
+        }
+        dispatch(c);
+    }
+    if (c->state == CONN_READING && c->peer_closed) conn_close(c);
+}
+
+static void conn_respond(HttpConn *c)
+{
+    conn_start_write(c);
+    process_buffered(c);
+}
+
+static void on_readable(HttpConn *c)
+{
+    while (c->req_len < HTTP_REQ_MAX - 1) {
+        ssize_t n = recv(c->fd, c->req + c->req_len,
+                         HTTP_REQ_MAX - 1 - c->req_len, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            conn_close(c);
+            return;
+        }
+        if (n == 0) {
+            c->peer_closed = true;
+            break;
+        }
+        c->req_len += (size_t)n;
+    }
+    process_buffered(c);
+}
+
+static void accept_clients(void)
+{
+    while (1) {
+        int fd = accept(server_sock, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            return;   // EAGAIN, or the listener is being shut down
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        // Every response is complete when it is written; with Nagle a
+        // pipelined one would wait for the client's delayed ACK.
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        HttpConn *c = NULL;
+        for (int i = 0; i < HTTP_MAX_CONNS; i++) {
+            if (g_conns[i].state == CONN_FREE) { c = &g_conns[i]; break; }
+        }
+        if (!c || !(c->req = pool_get(&g_req_pool))) {
+            static const char busy[] =
+                "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n"
+                "Connection: close\r\n\r\n";
+            ssize_t n = send(fd, busy, sizeof(busy) - 1, MSG_NOSIGNAL);
+            (void)n;
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->state = CONN_READING;
+        c->req_len = 0;
+        c->deadline_ms = now_ms() + HTTP_IO_TIMEOUT_MS;
+        conn_watch(c, EPOLLIN | EPOLLRDHUP);
     }
+}
 
-    send_response(client, "{\"error\":\"unknown endpoint\"}");
-    close(client);
+static void expire_connections(void)
+{
+    long long now = now_ms();
+    for (int i = 0; i < HTTP_MAX_CONNS; i++) {
+        HttpConn *c = &g_conns[i];
+        if (c->state == CONN_FREE || c->state == CONN_WORKING) continue;
+        if (now < c->deadline_ms) continue;
+        if (c->state == CONN_PARKED && c->batch) {
+            batch_finish(c);
+            conn_respond(c);
+        } else if (c->state == CONN_PARKED) {
+            set_response_status(c, 504, "{\"result\":\"failed\",\"reason\":\"timeout\"}");
+            conn_respond(c);
+        } else if (c->state == CONN_STREAM && c->sbuf_len == c->sbuf_off &&
+                   !c->exporting) {
+            // Idle stream: a comment line keeps proxies and dead-peer
+            // detection going.
+            if (c->ws) {
+                ws_send(c, WS_OP_PING, NULL, 0);
+            } else {
+                stream_append(c, ": ping\n\n", 8);
+            }
+            stream_service(c);
+        } else {
+            conn_close(c);
+        }
+    }
 }
 
 static void *server_loop(void *arg)
 {
     (void)arg;
+    struct epoll_event events[64];
     while (server_running) {
-        struct sockaddr_in cliaddr;
-        socklen_t len = sizeof(cliaddr);
-        int client = accept(server_sock, (struct sockaddr*)&cliaddr, &len);
-        if (client < 0) {
+        int n = epoll_wait(g_epfd, events, 64, 250);
+        if (n < 0) {
             if (errno == EINTR) continue;
+            perror("http_api: epoll_wait");
             break;
         }
-        handle_client(client);
+        for (int i = 0; i < n; i++) {
+            uint32_t tag = events[i].data.u32;
+            if (tag == TAG_LISTEN) {
+                accept_clients();
+            } else if (tag == TAG_WAKE) {
+                drain_done_queue();
+            } else if (tag == TAG_BUS) {
+                hub_bus_clear(g_results);
+                HubBusEvent ev;
+                bool any = false;
+                while (hub_bus_poll(g_results, &ev)) {
+                    any = true;
+                    if (ev.type == HUB_EV_COMMAND_RESULT) on_command_result(&ev);
+                }
+                // Streams read the history themselves; the bus only says
+                // that there is something new.
+                for (int k = 0; any && k < HTTP_MAX_CONNS; k++) {
+                    if (g_conns[k].state == CONN_STREAM) stream_service(&g_conns[k]);
+                }
+            } else if (tag < HTTP_MAX_CONNS) {
+                HttpConn *c = &g_conns[tag];
+                if (c->state == CONN_READING) {
+                    on_readable(c);
+                } else if (c->state == CONN_WRITING && conn_flush(c)) {
+                    conn_finish(c);
+                    process_buffered(c);
+                } else if (c->state == CONN_STREAM) {
+                    if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                        if (c->ws) {
+                            ws_read(c);
+                        } else {
+                            stream_read(c);
+                        }
+                    }
+                    if (c->state == CONN_STREAM && (events[i].events & EPOLLOUT)) {
+                        stream_service(c);
+                    }
+                }
+            }
+        }
+        expire_connections();
     }
     return NULL;
 }
 
+// ---------- start / stop ----------
+
+static void add_fd(int fd, uint32_t tag)
+{
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = tag };
+    epoll_ctl(g_epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static void release_resources(void)
+{
+    if (g_results) { hub_bus_unsubscribe(g_results); g_results = NULL; }
+    if (g_wakefd >= 0) { close(g_wakefd); g_wakefd = -1; }
+    if (g_epfd >= 0) { close(g_epfd); g_epfd = -1; }
+    if (server_sock >= 0) { close(server_sock); server_sock = -1; }
+    pool_drain(&g_req_pool);
+    pool_drain(&g_stream_pool);
+    free(g_api_token);
+    g_api_token = NULL;
+    g_api_token_len = 0;
+    static_unload();
+}
+
 bool http_api_start(const char *bind_addr, unsigned short port, const char *local_module_id)
 {
     if (server_running) return false;
     if (local_module_id) strncpy(g_module_id, local_module_id, sizeof(g_module_id)-1);
+    const char *token = getenv("HTTP_API_TOKEN");
+    if (token) {
+        g_api_token = strdup(token);
+        if (!g_api_token) return false;   // never fall back to no auth
+        g_api_token_len = strlen(token);
+    }
+    const char *static_dir = getenv("HTTP_STATIC_DIR");
+    if (static_dir && static_dir[0]) static_load(static_dir);
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    g_etag_epoch = (long long)ts.tv_sec * 1000LL + ts.tv_nsec / 1000000LL;
 
-    server_sock = socket(AF_INET, SOCK_STREAM, 0);
+    server_sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (server_sock < 0) return false;
 
     int opt = 1;
     setsockopt(server_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    // Clients always speak first: only report a connection once its
+    // request has arrived, saving a wakeup per connection.
+    int defer_s = 1;
+    setsockopt(server_sock, IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer_s, sizeof(defer_s));
 
     struct sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
@@ -297,20 +3002,55 @@ bool http_api_start(const char *bind_addr, unsigned short port, const char *loca
     addr.sin_port = htons(port);
     if (!bind_addr) bind_addr = "127.0.0.1";
     if (inet_pton(AF_INET, bind_addr, &addr.sin_addr) != 1) {
-        close(server_sock); server_sock = -1; return false;
+        release_resources(); return false;
     }
 
     if (bind(server_sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        close(server_sock); server_sock = -1; return false;
+        release_resources(); return false;
+    }
+
+    if (listen(server_sock, SOMAXCONN) < 0) {
+        release_resources(); return false;
+    }
+
+    g_epfd = epoll_create1(EPOLL_CLOEXEC);
+    g_wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    g_results = hub_bus_subscribe("http-api", HUB_EV_ALL, 256,
+                                  HUB_BP_DROP_OLDEST);
+    if (g_epfd < 0 || g_wakefd < 0 || !g_results) {
+        release_resources(); return false;
     }
+    add_fd(server_sock, TAG_LISTEN);
+    add_fd(g_wakefd, TAG_WAKE);
+    add_fd(hub_bus_fd(g_results), TAG_BUS);
 
-    if (listen(server_sock, 5) < 0) {
-        close(server_sock); server_sock = -1; return false;
+    for (int i = 0; i < HTTP_MAX_CONNS; i++) {
+        memset(&g_conns[i], 0, sizeof(g_conns[i]));
+        g_conns[i].fd = -1;
     }
+    memset(g_cmd_records, 0, sizeof(g_cmd_records));
+    memset(g_status_cache, 0, sizeof(g_status_cache));
+    g_status_all_valid = false;
+    g_job_head = g_job_count = 0;
+    g_done_head = g_done_count = 0;
+    g_workers_stop = false;
 
+    int started = 0;
+    while (started < HTTP_WORKERS &&
+           pthread_create(&g_workers[started], NULL, worker_loop, NULL) == 0) {
+        started++;
+    }
     server_running = 1;
-    if (pthread_create(&server_thread, NULL, server_loop, NULL) != 0) {
-        server_running = 0; close(server_sock); server_sock = -1; return false;
+    if (started < HTTP_WORKERS ||
+        pthread_create(&server_thread, NULL, server_loop, NULL) != 0) {
+        server_running = 0;
+        pthread_mutex_lock(&g_q_lock);
+        g_workers_stop = true;
+        pthread_cond_broadcast(&g_q_cond);
+        pthread_mutex_unlock(&g_q_lock);
+        for (int i = 0; i < started; i++) pthread_join(g_workers[i], NULL);
+        release_resources();
+        return false;
     }
     return true;
 }
@@ -319,10 +3059,21 @@ void http_api_stop(void)
 {
     if (!server_running) return;
     server_running = 0;
-    if (server_sock >= 0) {
-        shutdown(server_sock, SHUT_RDWR);
-        close(server_sock);
-        server_sock = -1;
-    }
+    uint64_t one = 1;
+    ssize_t n = write(g_wakefd, &one, sizeof(one));
+    (void)n;
     pthread_join(server_thread, NULL);
+
+    // Workers finish the job in hand; queued jobs are still run so every
+    // connection they own is handed back before it is closed.
+    pthread_mutex_lock(&g_q_lock);
+    g_workers_stop = true;
+    pthread_cond_broadcast(&g_q_cond);
+    pthread_mutex_unlock(&g_q_lock);
+    for (int i = 0; i < HTTP_WORKERS; i++) pthread_join(g_workers[i], NULL);
+
+    for (int i = 0; i < HTTP_MAX_CONNS; i++) {
+        if (g_conns[i].state != CONN_FREE) conn_close(&g_conns[i]);
+    }
+    release_resources();
 }
@@ -22,9 +22,61 @@ bool door_udp_init2(const char *host_ip, uint16_t notif_port, uint16_t hb_port,
                     DoorReportMode mode,
                     int heartbeat_period_ms);
 
+// Publish the current door state and send EVENT notifications for what
+// changed since the last call (the first call sends a HEARTBEAT instead).
+// Each EVENT ends in a sequence number and is resent until the hub ACKs
+// it; a newer state for the same channel replaces an unacked older one.
+// Safe to call from several threads.
 void door_udp_update(bool d0_open, bool d0_locked,
                      bool d1_open, bool d1_locked);
 
+// Send a HEARTBEAT with the state last passed to door_udp_update(). The
+// caller owns the schedule; heartbeat_period_ms given at init is not used
+// by the transport. Returns false if no state has been reported yet, the
+// socket is closed or heartbeats are not enabled.
+bool door_udp_heartbeat(void);
+
+// For the caller's heartbeat schedule, all CLOCK_MONOTONIC ms (0: never):
+// when an EVENT or FEEDBACK last went to the hub -- the hub counts any
+// packet as a sign of life -- and when door_udp_update() last saw the
+// state change. The liveness budget is how long the hub waits before it
+// marks a silent module offline, from its reply to our HELLO (0 until
+// it answers; older hubs do not).
+long long door_udp_last_notification_ms(void);
+long long door_udp_last_change_ms(void);
+int door_udp_liveness_budget_ms(void);
+
+// The socket commands from the hub arrive on, or -1 before init. The
+// transport runs no thread of its own: the caller waits for the fd to
+// become readable (poll/epoll) and then calls door_udp_poll().
+int door_udp_fd(void);
+
+// Read every datagram waiting on the socket without blocking and pass each
+// COMMAND for this module to the registered handler, on the calling thread.
+void door_udp_poll(void);
+
+// Becomes readable when an unacknowledged EVENT is due to be resent; the
+// caller then calls door_udp_service(). -1 before init.
+int door_udp_timer_fd(void);
+
+// Resend (or give up on) the EVENTs whose retransmit timeout has passed.
+void door_udp_service(void);
+
+// EVENT delivery counters since init. `superseded` counts events replaced
+// by a newer state before they were acked; `expired` counts events given
+// up on after repeated resends.
+typedef struct {
+    unsigned long sent;
+    unsigned long retransmits;
+    unsigned long acked;
+    unsigned long superseded;
+    unsigned long expired;
+    int unacked;    // events in flight now
+    int rto_ms;     // current retransmit timeout
+} DoorEventStats;
+
+void door_udp_event_stats(DoorEventStats *out);
+
 void door_udp_close(void);
 
 /* Command handler callback: invoked when a COMMAND is received for this module.
@@ -42,3 +94,9 @@ bool door_udp_register_command_handler(DoorCmdHandler handler, void *ctx);
  * Returns true if the send succeeded (socket open), false otherwise.
  */
 bool door_udp_send_feedback(const char *module, int cmdid, const char *target, const char *action);
+
+/* Tell the hub a COMMAND was queued for execution:
+ * "<MODULE> ACCEPTED <CMDID> <TARGET> <ACTION>". Its FEEDBACK follows once
+ * it has run. Returns false if the socket is closed.
+ */
+bool door_udp_send_accepted(const char *module, int cmdid, const char *target, const char *action);
@@ -0,0 +1,97 @@
+// hub_bus.h
+// In-process publish/subscribe bus for hub state changes.
+//
+// The hub publishes each door transition, online/offline change, feedback
+// and command result exactly once. Every subscriber owns a bounded
+// single-consumer ring. Publishing is serialized by one mutex, but never
+// waits for a consumer; consumers take no lock. When a ring is full the
+// subscriber's backpressure policy decides what is lost.
+// Each subscriber also has an eventfd that becomes readable when events
+// are pending, so consumers can block in poll()/epoll or hub_bus_wait().
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "hal/hub_udp.h"
+
+typedef enum {
+    HUB_EV_HELLO          = 1u << 0,
+    HUB_EV_HEARTBEAT      = 1u << 1,
+    HUB_EV_DOOR           = 1u << 2,   // door sensor transition (state = open)
+    HUB_EV_LOCK           = 1u << 3,   // lock transition (state = locked)
+    HUB_EV_ONLINE         = 1u << 4,
+    HUB_EV_OFFLINE        = 1u << 5,
+    HUB_EV_COMMAND        = 1u << 6,   // command forwarded to a module
+    HUB_EV_FEEDBACK       = 1u << 7,
+    HUB_EV_COMMAND_RESULT = 1u << 8    // hub-issued command acked/failed
+} HubEventType;
+
+#define HUB_EV_ALL        0x1ffu
+#define HUB_EV_TYPE_COUNT 9
+
+typedef struct {
+    uint64_t     seq;            // same sequence as the hub history
+    long long    timestamp_ms;
+    HubEventType type;
+    char         module_id[HUB_MODULE_ID_LEN];
+    char         channel[4];     // "D0"/"D1" for DOOR and LOCK
+    bool         state;          // DOOR: open, LOCK: locked, RESULT: acked
+    char         reason[12];     // COMMAND_RESULT when not acked: "no_ack",
+                                 // "superseded" or "aborted"
+    int          cmdid;          // COMMAND, FEEDBACK, COMMAND_RESULT
+    int          rtt_ms;         // COMMAND_RESULT
+    char         target[32];
+    char         action[32];
+    char         feedback[32];   // COMMAND_RESULT: the module's FEEDBACK action
+                                 // for this cmdid ("" if none came)
+} HubBusEvent;
+
+typedef enum {
+    HUB_BP_DROP_NEWEST,   // keep what is queued, discard the new event
+    HUB_BP_DROP_OLDEST    // discard the oldest queued event to make room
+} HubBackpressure;
+
+typedef struct HubBusSub HubBusSub;
+
+#define HUB_BUS_MAX_SUBS 16
+
+typedef struct {
+    uint64_t published[HUB_EV_TYPE_COUNT];   // indexed by bit position
+    int      num_subs;
+    struct {
+        char     name[24];
+        int      depth;
+        int      capacity;
+        uint64_t dropped;
+    } subs[HUB_BUS_MAX_SUBS];
+} HubBusStats;
+
+// Subscribe to the event types in `mask`. `capacity` is rounded up to a
+// power of two. Returns NULL if the subscriber table is full.
+HubBusSub *hub_bus_subscribe(const char *name, uint32_t mask, int capacity,
+                             HubBackpressure policy);
+void hub_bus_unsubscribe(HubBusSub *sub);
+
+// Publish to every matching subscriber. Never blocks on a consumer.
+void hub_bus_publish(const HubBusEvent *ev);
+
+// Pop one event without blocking. Returns false if the queue is empty.
+bool hub_bus_poll(HubBusSub *sub, HubBusEvent *out);
+
+// Block until an event is available (timeout_ms < 0 waits forever).
+// Returns false on timeout or after hub_bus_wake().
+bool hub_bus_wait(HubBusSub *sub, HubBusEvent *out, int timeout_ms);
+
+// Wake a consumer blocked in hub_bus_wait() (e.g. on shutdown).
+void hub_bus_wake(HubBusSub *sub);
+
+// eventfd that is readable while events may be pending. Consumers using
+// their own poll loop call hub_bus_clear() before draining with
+// hub_bus_poll().
+int  hub_bus_fd(const HubBusSub *sub);
+void hub_bus_clear(HubBusSub *sub);
+
+uint64_t hub_bus_dropped(const HubBusSub *sub);
+void hub_bus_get_stats(HubBusStats *out);
+
+// Short lowercase name for an event type ("door", "offline", ...).
+const char *hub_bus_type_name(HubEventType type);
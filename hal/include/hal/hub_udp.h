@@ -16,7 +16,7 @@
 typedef struct {
     char module_id[HUB_MODULE_ID_LEN];   // e.g., "D1"
     bool known;
-    bool offline;  // true if heartbeat not received for > 10 seconds
+    bool offline;  // true if nothing received from it for > 10 seconds
 
     bool d0_open;
     bool d0_locked;
@@ -24,6 +24,7 @@ typedef struct {
     bool d1_locked;
 
     long long last_heartbeat_ms;
+    long long last_seen_ms;    // any packet from the module; drives `offline`
     long long last_event_ms;
     long long last_online_ms;  // timestamp when module went offline (or 0 if online)
 
@@ -36,9 +37,22 @@ typedef struct {
     char last_feedback_target[32];
     char last_feedback_action[32];
     int last_feedback_cmdid;
+    // Sequence number of the newest EVENT applied on D0 and D1; older or
+    // repeated ones (resends, reordered datagrams) are acked but not
+    // applied. Per channel, since a module numbers both from one counter
+    // and a resent D1 EVENT may arrive after a newer D0 one.
+    bool has_event_seq[2];
+    uint32_t last_event_seq[2];
+    // hub_udp_state_version() as of this module's last change
+    uint64_t version;
 } HubDoorStatus;
 
+// History entry. `seq` increases by one per entry and matches the `seq`
+// of the corresponding hub_bus event; `type` is a HubEventType (0 for
+// untyped lines).
 typedef struct {
+    uint64_t seq;
+    int type;
     long long timestamp_ms;
     char module_id[HUB_MODULE_ID_LEN];
     char line[HUB_LINE_LEN];
@@ -62,9 +76,61 @@ void hub_udp_shutdown(void);
 // Returns true if that module is known and fills out *out.
 bool hub_udp_get_status(const char *module_id, HubDoorStatus *out);
 
+// Copy every known module's status into out[] (up to max_doors) and,
+// if `version` is non-NULL, the state version the snapshot reflects.
+// Returns the number of modules copied.
+int hub_udp_get_all_status(HubDoorStatus *out, int max_doors, uint64_t *version);
+
+// Monotonic counter bumped on every change to any module's status. Cheap
+// (no lock); equal values mean an unchanged hub_udp_get_all_status().
+uint64_t hub_udp_state_version(void);
+
+// The `version` of one module's status without copying it; equal values
+// mean an unchanged hub_udp_get_status(). Returns 0 if it is not known.
+uint64_t hub_udp_status_version(const char *module_id);
+
 // Copy up to max_events most recent events into out[].
 // Returns number of events copied (<= max_events).
 int hub_udp_get_history(HubEvent *out, int max_events);
 
-// Send a command to a known module (returns true on send success)
+// Copy up to max_events history entries with seq > after_seq, oldest
+// first. If some of those entries have already been overwritten, the first
+// copied seq is greater than after_seq + 1. Returns the number copied.
+int hub_udp_get_history_since(uint64_t after_seq, HubEvent *out, int max_events);
+
+// Sequence number of the newest history entry (0 if none yet).
+uint64_t hub_udp_history_seq(void);
+
+// Called by hub_udp_visit_history() for each matching entry, oldest first,
+// with the hub lock held: keep it short and do not call back into hub_udp.
+// Return false to stop the walk.
+typedef bool (*HubHistoryFn)(const HubEvent *e, void *ctx);
+
+// Walk the history entries with seq > after_seq from `module_id` (NULL or
+// "" for every module) whose type is in `type_mask` (0 for every entry,
+// untyped ones included). A module filter goes through a per-module index,
+// so it costs about as much as the entries it returns. Stores the newest
+// history seq in *newest_seq (if non-NULL). Returns the number of entries
+// passed to fn.
+int hub_udp_visit_history(const char *module_id, uint32_t type_mask,
+                          uint64_t after_seq, HubHistoryFn fn, void *ctx,
+                          uint64_t *newest_seq);
+
+// Send a command to a known module and block until its FEEDBACK arrives
+// or the retries run out. Returns true if the module acknowledged it.
 bool hub_udp_send_command(const char *module_id, const char *target, const char *action);
+
+// Non-blocking variant: queue the command and return its cmdid, or -1 if
+// the module has no known route. The hub thread retransmits it and
+// publishes the outcome as a HUB_EV_COMMAND_RESULT bus event with the same
+// cmdid (state = acked, reason = why not, rtt_ms = round trip).
+int hub_udp_submit_command(const char *module_id, const char *target, const char *action);
+
+// A command is resent every HUB_CMD_ACK_TIMEOUT_MS up to HUB_CMD_ATTEMPTS
+// times until the module answers ACCEPTED, then given HUB_CMD_RUN_TIMEOUT_MS
+// from ACCEPTED to send FEEDBACK. Its result is therefore published at the
+// latest HUB_CMD_MAX_MS after it was submitted.
+#define HUB_CMD_ACK_TIMEOUT_MS 500
+#define HUB_CMD_ATTEMPTS       3
+#define HUB_CMD_RUN_TIMEOUT_MS 15000
+#define HUB_CMD_MAX_MS (HUB_CMD_ACK_TIMEOUT_MS * HUB_CMD_ATTEMPTS + HUB_CMD_RUN_TIMEOUT_MS)
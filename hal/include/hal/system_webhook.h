@@ -1,20 +1,51 @@
 // hub_webhook.h
 // Thin asynchronous wrapper around hal DiscordAlert functions.
+//
+// Messages are queued in a bounded in-memory ring and, when a spool path is
+// configured, appended to an on-disk spool before being acknowledged. The
+// worker delivers them strictly in order, retrying failures with
+// exponential backoff and jitter; undelivered messages are replayed from the
+// spool on the next start.
 
 #ifndef HUB_WEBHOOK_H
 #define HUB_WEBHOOK_H
 
 #include <stdbool.h>
 
+#define HUB_WEBHOOK_MSG_MAX       512
+#define HUB_WEBHOOK_DEFAULT_SPOOL "/var/tmp/hub_webhook.spool"
+
+typedef struct {
+    int       depth;          // undelivered messages (memory + spool)
+    int       mem_depth;      // of which currently held in memory
+    long long oldest_age_ms;  // age of the oldest undelivered message
+    long long delivered;
+    long long retries;        // failed delivery attempts
+    long long dropped;        // rejected because the queue/spool was full
+} HubWebhookStats;
+
+// Set the spool file used by the next hub_webhook_init(). NULL or "" keeps
+// the queue memory-only. Defaults to $HUB_WEBHOOK_SPOOL, then
+// HUB_WEBHOOK_DEFAULT_SPOOL.
+void hub_webhook_set_spool_path(const char *path);
+
 // Initialize webhook worker. Pass NULL to skip initialization.
 // Returns true on success.
 bool hub_webhook_init(const char *webhook_url);
 
-// Shutdown worker and cleanup resources.
+// Shutdown worker and cleanup resources. Undelivered spooled messages are
+// kept on disk for the next start.
 void hub_webhook_shutdown(void);
 
 // Enqueue a message to be sent to the webhook (non-blocking).
 // The message will be copied; caller may free the buffer after return.
-void hub_webhook_send(const char *msg);
+// Returns false if the worker isn't running or the queue is full.
+bool hub_webhook_send(const char *msg);
+
+// True between a successful hub_webhook_init() and hub_webhook_shutdown().
+bool hub_webhook_is_running(void);
+
+// Snapshot queue depth / oldest-message age / delivery counters.
+void hub_webhook_get_stats(HubWebhookStats *out);
 
 #endif // HUB_WEBHOOK_H
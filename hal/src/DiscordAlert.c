@@ -8,6 +8,6 @@
 
 __attribute__((weak)) bool discordStart(void) { return true; }
 __attribute__((weak)) void discordCleanup(void) { }
-__attribute__((weak)) void sendDiscordAlert(const char *webhook_url, const char *msg) { (void)webhook_url; (void)msg; }
-__attribute__((weak)) bool startDoorAlertMonitor(char *(*provider)(void *), void *ctx, const char *webhook_url) { (void)provider; (void)ctx; (void)webhook_url; return false; }
+__attribute__((weak)) bool sendDiscordAlert(const char *webhook_url, const char *msg) { (void)webhook_url; (void)msg; return false; }
+__attribute__((weak)) bool startDoorAlertMonitor(const char *module_id, char *(*provider)(void *), void *ctx, const char *webhook_url) { (void)module_id; (void)provider; (void)ctx; (void)webhook_url; return false; }
 __attribute__((weak)) void stopDoorAlertMonitor(void) { }
\ No newline at end of file
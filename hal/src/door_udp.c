@@ -9,10 +9,14 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
 #include <time.h>
 #include <sys/time.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include "hal/timing.h"
 
 #define BUF_MAX 256
@@ -22,9 +26,6 @@ static int g_sock = -1;
 static struct sockaddr_in g_dest_notif;
 static struct sockaddr_in g_dest_hb;
 static socklen_t g_dest_len = 0;
-// Command listener
-static pthread_t g_cmd_thread;
-static volatile int g_cmd_running = 0;
 static uint16_t g_bound_notif_port = 0;
 
 // Forward declarations for helpers used before their definitions
@@ -34,17 +35,23 @@ static void send_line_hb(const char *line);
 // Module identity + reporting settings
 static char           g_module_id[16]       = "M?";
 static DoorReportMode g_mode                = DOOR_REPORT_NOTIFICATION;
-static int            g_heartbeat_period_ms = 1000;
 
-// Previous-state tracking
-static bool g_prev_valid    = false;
-static bool g_prev_d0_open  = false;
-static bool g_prev_d0_locked= false;
-static bool g_prev_d1_open  = false;
-static bool g_prev_d1_locked= false;
-
-// Heartbeat timer
-static long long g_last_heartbeat_ms = 0;
+// Last reported state, published as a single word. door_udp_update() is
+// called from both the heartbeat scheduler and the command thread; the
+// atomic exchange hands each caller the state it replaced, so every change
+// is announced exactly once and door_udp_heartbeat() reads a consistent
+// snapshot, all without a lock.
+#define STATE_D0_OPEN   (1u << 0)
+#define STATE_D0_LOCKED (1u << 1)
+#define STATE_D1_OPEN   (1u << 2)
+#define STATE_D1_LOCKED (1u << 3)
+#define STATE_VALID     (1u << 4)   // set once a state has been reported
+static _Atomic unsigned g_state = 0;
+
+// Liveness facts for the caller's heartbeat schedule, CLOCK_MONOTONIC ms.
+static _Atomic long long g_last_notif_ms = 0;    // last EVENT/FEEDBACK sent
+static _Atomic long long g_last_change_ms = 0;   // last state change seen
+static _Atomic int       g_liveness_budget_ms = 0; // from the hub's HELLO reply
 
 /* Registered command handler (set by the app layer) */
 static DoorCmdHandler g_cmd_handler = NULL;
@@ -66,7 +73,65 @@ bool door_udp_send_feedback(const char *module, int cmdid, const char *target, c
     return true;
 }
 
-// ---------------- time helper ----------------
+bool door_udp_send_accepted(const char *module, int cmdid, const char *target, const char *action)
+{
+    if (g_sock < 0) return false;
+    char out[BUF_MAX];
+    snprintf(out, sizeof(out), "%s ACCEPTED %d %s %s\n", module, cmdid, target, action);
+    send_line_notif(out);
+    return true;
+}
+
+// ---------------- heartbeat formatting ----------------
+static void format_heartbeat(char *buf, size_t size, unsigned state)
+{
+    /* Keep backwards-compatible comma-separated states so the hub's
+     * parser (which expects "D0=OPEN,LOCKED") continues to work.
+     * Map D0 -> door sensor, D1 -> lock state. For a single-door
+     * module we populate both tokens with the same logical door
+     * + lock pair so existing consumers see both values. */
+    bool d0_open = state & STATE_D0_OPEN;
+    bool d1_locked = state & STATE_D1_LOCKED;
+    snprintf(buf, size,
+             "%s HEARTBEAT D0=%s,%s D1=%s,%s\n",
+             g_module_id,
+             d0_open   ? "OPEN" : "CLOSED",
+             d1_locked ? "LOCKED" : "UNLOCKED",
+             d0_open   ? "OPEN" : "CLOSED",
+             d1_locked ? "LOCKED" : "UNLOCKED");
+}
+
+// ---------------- reliable EVENT delivery ----------------
+// Every EVENT carries a sequence number as its last token and is resent
+// until the hub answers "<MODULE> ACK <SEQ>". There is one slot per
+// channel, so a newer state replaces an unacked older one and a burst of
+// changes leaves only the latest state in flight. The retransmit timeout
+// follows the measured round trip (RFC 6298: SRTT + 4 * RTTVAR, sampled
+// from first transmissions only) and doubles with each resend.
+#define EVENT_CHANNELS       2      // 0: D0 DOOR, 1: D1 LOCK
+#define EVENT_MAX_ATTEMPTS   8
+#define EVENT_RTO_INITIAL_MS 250
+#define EVENT_RTO_MIN_MS     50
+#define EVENT_RTO_MAX_MS     2000
+
+typedef struct {
+    bool      pending;
+    uint32_t  seq;
+    char      line[BUF_MAX];
+    long long first_tx_ms;
+    long long next_tx_ms;
+    int       attempts;
+} PendingEvent;
+
+static pthread_mutex_t g_ev_lock = PTHREAD_MUTEX_INITIALIZER;
+static PendingEvent    g_events[EVENT_CHANNELS];
+static uint32_t        g_ev_seq = 0;
+static int             g_srtt_ms = 0;        // 0 until the first sample
+static int             g_rttvar_ms = 0;
+static int             g_rto_ms = EVENT_RTO_INITIAL_MS;
+static int             g_ev_timerfd = -1;    // fires at the next resend
+static DoorEventStats  g_ev_stats;
+
 static long long now_ms(void)
 {
     struct timespec ts;
@@ -74,10 +139,92 @@ static long long now_ms(void)
     return (long long)ts.tv_sec * 1000LL + ts.tv_nsec / 1000000LL;
 }
 
+// Arm the retransmit timer for the earliest pending event, or disarm it.
+// Call with g_ev_lock held.
+static void events_arm_timer(void)
+{
+    if (g_ev_timerfd < 0) return;
+    long long next = 0;
+    for (int i = 0; i < EVENT_CHANNELS; i++) {
+        if (g_events[i].pending && (next == 0 || g_events[i].next_tx_ms < next)) {
+            next = g_events[i].next_tx_ms;
+        }
+    }
+    struct itimerspec its = { 0 };
+    its.it_value.tv_sec = next / 1000;
+    its.it_value.tv_nsec = (long)(next % 1000) * 1000000L;
+    timerfd_settime(g_ev_timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+static void events_reset(void)
+{
+    pthread_mutex_lock(&g_ev_lock);
+    memset(g_events, 0, sizeof(g_events));
+    memset(&g_ev_stats, 0, sizeof(g_ev_stats));
+    g_srtt_ms = g_rttvar_ms = 0;
+    g_rto_ms = EVENT_RTO_INITIAL_MS;
+    // Seed from the wall clock so a restarted module's sequence numbers
+    // are ahead of the ones the hub saw before the restart.
+    g_ev_seq = (uint32_t)getTimeInMs();
+    if (g_ev_timerfd < 0) {
+        g_ev_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    }
+    events_arm_timer();
+    pthread_mutex_unlock(&g_ev_lock);
+}
+
+// Send `event` ("<MODULE> EVENT <CH> <WHAT> <STATE>") on `channel`,
+// superseding whatever that channel still has in flight.
+static void send_event(int channel, const char *event)
+{
+    pthread_mutex_lock(&g_ev_lock);
+    PendingEvent *e = &g_events[channel];
+    if (e->pending) g_ev_stats.superseded++;
+    long long now = now_ms();
+    e->pending = true;
+    e->seq = ++g_ev_seq;
+    snprintf(e->line, sizeof(e->line), "%s %u\n", event, (unsigned)e->seq);
+    e->first_tx_ms = now;
+    e->next_tx_ms = now + g_rto_ms;
+    e->attempts = 1;
+    g_ev_stats.sent++;
+    send_line_notif(e->line);
+    events_arm_timer();
+    pthread_mutex_unlock(&g_ev_lock);
+}
+
+static void event_acked(uint32_t seq)
+{
+    pthread_mutex_lock(&g_ev_lock);
+    for (int i = 0; i < EVENT_CHANNELS; i++) {
+        PendingEvent *e = &g_events[i];
+        if (!e->pending || e->seq != seq) continue;
+        if (e->attempts == 1) {
+            int r = (int)(now_ms() - e->first_tx_ms);
+            if (g_srtt_ms == 0) {
+                g_srtt_ms = r > 0 ? r : 1;
+                g_rttvar_ms = r / 2;
+            } else {
+                g_rttvar_ms = (3 * g_rttvar_ms + abs(g_srtt_ms - r)) / 4;
+                g_srtt_ms = (7 * g_srtt_ms + r) / 8;
+            }
+            g_rto_ms = g_srtt_ms + 4 * g_rttvar_ms;
+            if (g_rto_ms < EVENT_RTO_MIN_MS) g_rto_ms = EVENT_RTO_MIN_MS;
+            if (g_rto_ms > EVENT_RTO_MAX_MS) g_rto_ms = EVENT_RTO_MAX_MS;
+        }
+        e->pending = false;
+        g_ev_stats.acked++;
+        events_arm_timer();
+        break;
+    }
+    pthread_mutex_unlock(&g_ev_lock);
+}
+
 // ---------------- UDP send helper ----------------
 static void send_line_notif(const char *line)
 {
     if (g_sock < 0) return;
+    atomic_store(&g_last_notif_ms, now_ms());
     sendto(g_sock, line, strlen(line), 0,
            (struct sockaddr *)&g_dest_notif, g_dest_len);
 }
@@ -89,57 +236,53 @@ static void send_line_hb(const char *line)
            (struct sockaddr *)&g_dest_hb, g_dest_len);
 }
 
-static void *door_cmd_thread(void *arg)
+// Handle one datagram from the hub:
+// <MODULE> COMMAND <CMDID> <TARGET> <ACTION>
+static void handle_datagram(char *buf, ssize_t n, const struct sockaddr_in *src)
 {
-    (void)arg;
-    fprintf(stderr, "[door_cmd_thread] Listener thread started, waiting for incoming datagrams...\n");
-    char buf[BUF_MAX];
-    struct sockaddr_in src;
-    socklen_t srclen = sizeof(src);
-
-    while (g_cmd_running) {
-        ssize_t n = recvfrom(g_sock, buf, sizeof(buf)-1, 0,
-                             (struct sockaddr *)&src, &srclen);
-        if (n < 0) {
-            if (errno == EINTR) continue;
-            /* Timeout or no data; re-check the running flag to exit cleanly. */
-            if (errno == EAGAIN || errno == EWOULDBLOCK) continue;
-            fprintf(stderr, "[door_cmd_thread] recvfrom error: %s\n", strerror(errno));
-            sleepForMs(1);
-            continue;
+    char src_ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &src->sin_addr, src_ip, INET_ADDRSTRLEN);
+    fprintf(stderr, "[door_udp_poll] RECEIVED: %zd bytes from %s:%u: '%s'\n", n, src_ip, ntohs(src->sin_port), buf);
+
+    char *save = NULL;
+    char *mod = strtok_r(buf, " \t\r\n", &save);
+    if (!mod) return;
+    char *type = strtok_r(NULL, " \t\r\n", &save);
+    if (!type) return;
+    if (strcmp(type, "HELLO") == 0) {
+        // The hub's reply to our HELLO: <MODULE> HELLO <LIVENESS_MS>
+        char *budget_s = strtok_r(NULL, " \t\r\n", &save);
+        if (budget_s && strcmp(mod, g_module_id) == 0) {
+            atomic_store(&g_liveness_budget_ms, atoi(budget_s));
         }
-        buf[n] = '\0';
-        char src_ip[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &src.sin_addr, src_ip, INET_ADDRSTRLEN);
-        fprintf(stderr, "[door_cmd_thread] RECEIVED: %zd bytes from %s:%u: '%s'\n", n, src_ip, ntohs(src.sin_port), buf);
-
-        // parse: <MODULE> COMMAND <CMDID> <TARGET> <ACTION>
-        char *save = NULL;
-        char *mod = strtok_r(buf, " \t\r\n", &save);
-        if (!mod) continue;
-        char *type = strtok_r(NULL, " \t\r\n", &save);
-        if (!type) continue;
-        if (strcmp(type, "COMMAND") != 0) continue;
-        char *cmdid_s = strtok_r(NULL, " \t\r\n", &save);
-        char *target = strtok_r(NULL, " \t\r\n", &save);
-        char *action = strtok_r(NULL, " \t\r\n", &save);
-        int cmdid = 0;
-        if (cmdid_s) cmdid = atoi(cmdid_s);
-        if (!target || !action) continue;
-
-        // Only act on commands addressed to this module
-        if (strcmp(mod, g_module_id) == 0) {
-            if (g_cmd_handler) {
-                g_cmd_handler(mod, cmdid, target, action, g_cmd_handler_ctx);
-            } else {
-                // No handler registered: keep legacy behavior and send basic FEEDBACK
-                char out[BUF_MAX];
-                snprintf(out, sizeof(out), "%s FEEDBACK %d %s %s\n", g_module_id, cmdid, target, action);
-                send_line_notif(out);
-            }
+        return;
+    }
+    if (strcmp(type, "ACK") == 0) {
+        char *seq_s = strtok_r(NULL, " \t\r\n", &save);
+        if (seq_s && strcmp(mod, g_module_id) == 0) {
+            event_acked((uint32_t)strtoul(seq_s, NULL, 10));
+        }
+        return;
+    }
+    if (strcmp(type, "COMMAND") != 0) return;
+    char *cmdid_s = strtok_r(NULL, " \t\r\n", &save);
+    char *target = strtok_r(NULL, " \t\r\n", &save);
+    char *action = strtok_r(NULL, " \t\r\n", &save);
+    int cmdid = 0;
+    if (cmdid_s) cmdid = atoi(cmdid_s);
+    if (!target || !action) return;
+
+    // Only act on commands addressed to this module
+    if (strcmp(mod, g_module_id) == 0) {
+        if (g_cmd_handler) {
+            g_cmd_handler(mod, cmdid, target, action, g_cmd_handler_ctx);
+        } else {
+            // No handler registered: keep legacy behavior and send basic FEEDBACK
+            char out[BUF_MAX];
+            snprintf(out, sizeof(out), "%s FEEDBACK %d %s %s\n", g_module_id, cmdid, target, action);
+            send_line_notif(out);
         }
     }
-    return NULL;
 }
 
 // ---------------- Public API ----------------
@@ -154,12 +297,14 @@ bool door_udp_init(const char *host_ip, uint16_t port,
         return false;
     }
 
+    (void)heartbeat_period_ms;  // the caller schedules door_udp_heartbeat()
     snprintf(g_module_id, sizeof(g_module_id), "%s", module_id);
     g_mode = mode;
-    g_heartbeat_period_ms = heartbeat_period_ms > 0 ? heartbeat_period_ms : 1000;
-
-    g_prev_valid = false;
-    g_last_heartbeat_ms = now_ms();
+    atomic_store(&g_state, 0);
+    atomic_store(&g_last_notif_ms, 0);
+    atomic_store(&g_last_change_ms, 0);
+    atomic_store(&g_liveness_budget_ms, 0);
+    events_reset();
 
     // Create UDP socket
     int s = socket(AF_INET, SOCK_DGRAM, 0);
@@ -168,18 +313,6 @@ bool door_udp_init(const char *host_ip, uint16_t port,
         return false;
     }
 
-    /* Make recvfrom() time out periodically so the command listener
-     * thread can observe `g_cmd_running` and exit cleanly on shutdown. */
-    struct timeval tv2;
-    tv2.tv_sec = 1; tv2.tv_usec = 0; /* 1s */
-    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv2, sizeof(tv2));
-
-    /* Make recvfrom() time out periodically so the command listener
-     * thread can observe `g_cmd_running` and exit cleanly on shutdown. */
-    struct timeval tv;
-    tv.tv_sec = 1; tv.tv_usec = 0; /* 1s */
-    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-
     // Destination addresses (the HUB) - notifications and heartbeats
     memset(&g_dest_notif, 0, sizeof(g_dest_notif));
     g_dest_notif.sin_family = AF_INET;
@@ -229,10 +362,11 @@ bool door_udp_init2(const char *host_ip, uint16_t notif_port, uint16_t hb_port,
     snprintf(g_module_id, sizeof(g_module_id), "%s", module_id);
     fprintf(stderr, "[door_udp_init2] Set g_module_id from '%s' (param) to '%s' (global)\n", module_id, g_module_id);
     g_mode = mode;
-    g_heartbeat_period_ms = heartbeat_period_ms > 0 ? heartbeat_period_ms : 1000;
-
-    g_prev_valid = false;
-    g_last_heartbeat_ms = now_ms();
+    atomic_store(&g_state, 0);
+    atomic_store(&g_last_notif_ms, 0);
+    atomic_store(&g_last_change_ms, 0);
+    atomic_store(&g_liveness_budget_ms, 0);
+    events_reset();
 
     int s = socket(AF_INET, SOCK_DGRAM, 0);
     if (s < 0) {
@@ -291,16 +425,6 @@ bool door_udp_init2(const char *host_ip, uint16_t notif_port, uint16_t hb_port,
         fprintf(stderr, "[door_udp_init2] HELLO sent: %zd bytes\n", sent);
     }
 
-    // Start command listener
-    g_cmd_running = 1;
-    fprintf(stderr, "[door_udp_init2] Creating command listener thread...\n");
-    if (pthread_create(&g_cmd_thread, NULL, door_cmd_thread, NULL) != 0) {
-        perror("[door_udp_init2] pthread_create FAILED");
-        fprintf(stderr, "[door_udp_init2] ERROR: Failed to spawn listener thread\n");
-        g_cmd_running = 0;
-        return false;
-    }
-    fprintf(stderr, "[door_udp_init2] Command listener thread created successfully\n");
     fprintf(stderr, "[door_udp_init2] INIT COMPLETE: Module listening on port %u\n", notif_port);
 
     return true;
@@ -311,32 +435,19 @@ void door_udp_update(bool d0_open, bool d0_locked,
 {
     if (g_sock < 0) return;
 
-    long long t = now_ms();
+    unsigned state = STATE_VALID |
+                     (d0_open   ? STATE_D0_OPEN   : 0) |
+                     (d0_locked ? STATE_D0_LOCKED : 0) |
+                     (d1_open   ? STATE_D1_OPEN   : 0) |
+                     (d1_locked ? STATE_D1_LOCKED : 0);
+    unsigned prev = atomic_exchange(&g_state, state);
     char buf[BUF_MAX];
+    if (state != prev) atomic_store(&g_last_change_ms, now_ms());
 
     // First update → send initial heartbeat
-    if (!g_prev_valid) {
-        g_prev_d0_open   = d0_open;
-        g_prev_d0_locked = d0_locked;
-        g_prev_d1_open   = d1_open;
-        g_prev_d1_locked = d1_locked;
-
-        g_prev_valid = true;
-        g_last_heartbeat_ms = t;
-
+    if (!(prev & STATE_VALID)) {
         if (g_mode & DOOR_REPORT_HEARTBEAT) {
-            /* Keep backwards-compatible comma-separated states so the hub's
-             * parser (which expects "D0=OPEN,LOCKED") continues to work.
-             * Map D0 -> door sensor, D1 -> lock state. For a single-door
-             * module we populate both tokens with the same logical door
-             * + lock pair so existing consumers see both values. */
-            snprintf(buf, sizeof(buf),
-                     "%s HEARTBEAT D0=%s,%s D1=%s,%s\n",
-                     g_module_id,
-                     d0_open   ? "OPEN" : "CLOSED",
-                     d1_locked ? "LOCKED" : "UNLOCKED",
-                     d0_open   ? "OPEN" : "CLOSED",
-                     d1_locked ? "LOCKED" : "UNLOCKED");
+            format_heartbeat(buf, sizeof(buf), state);
             send_line_hb(buf);
         }
         return;
@@ -344,61 +455,140 @@ void door_udp_update(bool d0_open, bool d0_locked,
 
     // -------- Notifications (state change only) --------
     if (g_mode & DOOR_REPORT_NOTIFICATION) {
-        if (d0_open != g_prev_d0_open) {
+        if ((state ^ prev) & STATE_D0_OPEN) {
             snprintf(buf, sizeof(buf),
-                     "%s EVENT D0 DOOR %s\n",
+                     "%s EVENT D0 DOOR %s",
                      g_module_id,
                      d0_open ? "OPEN" : "CLOSED");
-            send_line_notif(buf);
+            send_event(0, buf);
         }
         /* D0 is sensor-only (door state). D1 is lock-only (lock state).
          * Only emit D0 DOOR events and D1 LOCK events. */
-        if (d1_locked != g_prev_d1_locked) {
+        if ((state ^ prev) & STATE_D1_LOCKED) {
             snprintf(buf, sizeof(buf),
-                     "%s EVENT D1 LOCK %s\n",
+                     "%s EVENT D1 LOCK %s",
                      g_module_id,
                      d1_locked ? "LOCKED" : "UNLOCKED");
-            send_line_notif(buf);
+            send_event(1, buf);
         }
     }
+}
 
-    // -------- Periodic heartbeat --------
-    if (g_mode & DOOR_REPORT_HEARTBEAT) {
-        if (t - g_last_heartbeat_ms >= g_heartbeat_period_ms) {
-            /* Emit combined D0/D1 tokens for compatibility. Use d0_open
-             * for the door state and d1_locked for the lock state. */
-            snprintf(buf, sizeof(buf),
-                     "%s HEARTBEAT D0=%s,%s D1=%s,%s\n",
-                     g_module_id,
-                     d0_open   ? "OPEN" : "CLOSED",
-                     d1_locked ? "LOCKED" : "UNLOCKED",
-                     d0_open   ? "OPEN" : "CLOSED",
-                     d1_locked ? "LOCKED" : "UNLOCKED");
-            send_line_hb(buf);
-            g_last_heartbeat_ms = t;
+bool door_udp_heartbeat(void)
+{
+    unsigned state = atomic_load(&g_state);
+    if (g_sock < 0 || !(state & STATE_VALID) || !(g_mode & DOOR_REPORT_HEARTBEAT)) {
+        return false;
+    }
+    char buf[BUF_MAX];
+    format_heartbeat(buf, sizeof(buf), state);
+    send_line_hb(buf);
+    return true;
+}
+
+long long door_udp_last_notification_ms(void)
+{
+    return atomic_load(&g_last_notif_ms);
+}
+
+long long door_udp_last_change_ms(void)
+{
+    return atomic_load(&g_last_change_ms);
+}
+
+int door_udp_liveness_budget_ms(void)
+{
+    return atomic_load(&g_liveness_budget_ms);
+}
+
+int door_udp_fd(void)
+{
+    return g_sock;
+}
+
+void door_udp_poll(void)
+{
+    if (g_sock < 0) return;
+    char buf[BUF_MAX];
+    struct sockaddr_in src;
+    while (1) {
+        socklen_t srclen = sizeof(src);
+        ssize_t n = recvfrom(g_sock, buf, sizeof(buf)-1, MSG_DONTWAIT,
+                             (struct sockaddr *)&src, &srclen);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                fprintf(stderr, "[door_udp_poll] recvfrom error: %s\n", strerror(errno));
+            }
+            return;
         }
+        buf[n] = '\0';
+        handle_datagram(buf, n, &src);
     }
+}
 
-    // -------- Save previous state --------
-    g_prev_d0_open   = d0_open;
-    g_prev_d0_locked = d0_locked;
-    g_prev_d1_open   = d1_open;
-    g_prev_d1_locked = d1_locked;
+int door_udp_timer_fd(void)
+{
+    return g_ev_timerfd;
 }
 
-void door_udp_close(void)
+void door_udp_service(void)
 {
-    // Stop command listener first so the thread can exit on its recv timeout.
-    if (g_cmd_running) {
-        g_cmd_running = 0;
-        pthread_join(g_cmd_thread, NULL);
+    uint64_t expirations;
+    if (g_ev_timerfd >= 0) {
+        ssize_t n = read(g_ev_timerfd, &expirations, sizeof(expirations));
+        (void)n;
     }
 
+    pthread_mutex_lock(&g_ev_lock);
+    long long now = now_ms();
+    for (int i = 0; i < EVENT_CHANNELS; i++) {
+        PendingEvent *e = &g_events[i];
+        if (!e->pending || e->next_tx_ms > now) continue;
+        if (e->attempts >= EVENT_MAX_ATTEMPTS) {
+            // The hub is unreachable; the next heartbeat still carries it.
+            e->pending = false;
+            g_ev_stats.expired++;
+            continue;
+        }
+        int backoff = g_rto_ms << e->attempts;
+        if (backoff > EVENT_RTO_MAX_MS) backoff = EVENT_RTO_MAX_MS;
+        e->attempts++;
+        e->next_tx_ms = now + backoff;
+        g_ev_stats.retransmits++;
+        send_line_notif(e->line);
+    }
+    events_arm_timer();
+    pthread_mutex_unlock(&g_ev_lock);
+}
+
+void door_udp_event_stats(DoorEventStats *out)
+{
+    if (!out) return;
+    pthread_mutex_lock(&g_ev_lock);
+    *out = g_ev_stats;
+    out->rto_ms = g_rto_ms;
+    for (int i = 0; i < EVENT_CHANNELS; i++) {
+        if (g_events[i].pending) out->unacked++;
+    }
+    pthread_mutex_unlock(&g_ev_lock);
+}
+
+void door_udp_close(void)
+{
     if (g_sock >= 0) {
         close(g_sock);
         g_sock = -1;
     }
 
     g_dest_len = 0;
-    g_prev_valid = false;
+    atomic_store(&g_state, 0);
+
+    pthread_mutex_lock(&g_ev_lock);
+    memset(g_events, 0, sizeof(g_events));
+    if (g_ev_timerfd >= 0) {
+        close(g_ev_timerfd);
+        g_ev_timerfd = -1;
+    }
+    pthread_mutex_unlock(&g_ev_lock);
 }
@@ -0,0 +1,249 @@
+// hub_bus.c
+#define _POSIX_C_SOURCE 200809L
+#include "hal/hub_bus.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+// A ring slot. `stamp` says who may touch `ev`: position p + 1 once the
+// event for position p is in it, and p + cap once the consumer has copied
+// it out, which frees it for position p + cap. Neither side reads or
+// writes `ev` without first seeing the stamp (or winning `head`) for it.
+typedef struct {
+    _Atomic uint64_t stamp;
+    HubBusEvent      ev;
+} HubBusSlot;
+
+struct HubBusSub {
+    char             name[24];
+    uint32_t         mask;
+    HubBackpressure  policy;
+    uint32_t         cap;          // power of two
+    HubBusSlot      *ring;
+    _Atomic uint64_t head;         // next slot to consume
+    _Atomic uint64_t tail;         // next slot to fill
+    _Atomic uint64_t dropped;
+    atomic_bool      wake;
+    int              efd;
+    bool             in_use;
+};
+
+// Publishers (and subscribe/unsubscribe) are serialized by g_pub_lock;
+// consumers never take it, they only move `head` and the slot stamps.
+static pthread_mutex_t  g_pub_lock = PTHREAD_MUTEX_INITIALIZER;
+static HubBusSub        g_subs[HUB_BUS_MAX_SUBS];
+static _Atomic uint64_t g_published[HUB_EV_TYPE_COUNT];
+
+static int type_index(HubEventType type)
+{
+    for (int i = 0; i < HUB_EV_TYPE_COUNT; i++) {
+        if ((uint32_t)type == (1u << i)) return i;
+    }
+    return -1;
+}
+
+const char *hub_bus_type_name(HubEventType type)
+{
+    static const char *names[HUB_EV_TYPE_COUNT] = {
+        "hello", "heartbeat", "door", "lock", "online", "offline",
+        "command", "feedback", "command_result"
+    };
+    int i = type_index(type);
+    return (i >= 0) ? names[i] : "unknown";
+}
+
+static void signal_fd(int efd)
+{
+    uint64_t one = 1;
+    ssize_t n = write(efd, &one, sizeof(one));
+    (void)n;   // EAGAIN means the counter is already non-zero
+}
+
+HubBusSub *hub_bus_subscribe(const char *name, uint32_t mask, int capacity,
+                             HubBackpressure policy)
+{
+    uint32_t cap = 8;
+    while ((int)cap < capacity && cap < (1u << 16)) cap <<= 1;
+
+    HubBusSlot *ring = calloc(cap, sizeof(*ring));
+    if (!ring) return NULL;
+    for (uint32_t i = 0; i < cap; i++) atomic_init(&ring[i].stamp, i);
+    int efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (efd < 0) {
+        perror("hub_bus: eventfd");
+        free(ring);
+        return NULL;
+    }
+
+    HubBusSub *sub = NULL;
+    pthread_mutex_lock(&g_pub_lock);
+    for (int i = 0; i < HUB_BUS_MAX_SUBS; i++) {
+        if (!g_subs[i].in_use) {
+            sub = &g_subs[i];
+            snprintf(sub->name, sizeof(sub->name), "%s", name ? name : "?");
+            sub->mask   = mask;
+            sub->policy = policy;
+            sub->cap    = cap;
+            sub->ring   = ring;
+            sub->efd    = efd;
+            atomic_store(&sub->head, 0);
+            atomic_store(&sub->tail, 0);
+            atomic_store(&sub->dropped, 0);
+            atomic_store(&sub->wake, false);
+            sub->in_use = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_pub_lock);
+
+    if (!sub) {
+        fprintf(stderr, "hub_bus: subscriber table full; cannot add '%s'\n",
+                name ? name : "?");
+        close(efd);
+        free(ring);
+    }
+    return sub;
+}
+
+void hub_bus_unsubscribe(HubBusSub *sub)
+{
+    if (!sub) return;
+    pthread_mutex_lock(&g_pub_lock);
+    HubBusSlot *ring = sub->ring;
+    int efd = sub->efd;
+    sub->in_use = false;
+    sub->ring = NULL;
+    sub->efd = -1;
+    pthread_mutex_unlock(&g_pub_lock);
+    close(efd);
+    free(ring);
+}
+
+void hub_bus_publish(const HubBusEvent *ev)
+{
+    if (!ev) return;
+    int ti = type_index(ev->type);
+    if (ti >= 0) atomic_fetch_add(&g_published[ti], 1);
+
+    pthread_mutex_lock(&g_pub_lock);
+    for (int i = 0; i < HUB_BUS_MAX_SUBS; i++) {
+        HubBusSub *s = &g_subs[i];
+        if (!s->in_use || !(s->mask & (uint32_t)ev->type)) continue;
+
+        uint64_t t = atomic_load_explicit(&s->tail, memory_order_relaxed);
+        uint64_t h = atomic_load_explicit(&s->head, memory_order_acquire);
+        HubBusSlot *slot = &s->ring[t & (s->cap - 1)];
+        bool owned = false;
+        if (t - h >= s->cap) {
+            if (s->policy == HUB_BP_DROP_NEWEST) {
+                atomic_fetch_add(&s->dropped, 1);
+                continue;
+            }
+            // Drop-oldest: claim the consumer's next slot, which is the one
+            // position t goes in. If the consumer got there first it may
+            // still be copying, and the stamp check below decides.
+            owned = atomic_compare_exchange_strong(&s->head, &h, h + 1);
+            if (owned) atomic_fetch_add(&s->dropped, 1);
+        }
+        if (!owned &&
+            atomic_load_explicit(&slot->stamp, memory_order_acquire) != t) {
+            // The consumer has claimed the slot's previous event but not
+            // finished copying it; drop this one rather than wait.
+            atomic_fetch_add(&s->dropped, 1);
+            continue;
+        }
+        slot->ev = *ev;
+        atomic_store_explicit(&slot->stamp, t + 1, memory_order_release);
+        atomic_store_explicit(&s->tail, t + 1, memory_order_release);
+        signal_fd(s->efd);
+    }
+    pthread_mutex_unlock(&g_pub_lock);
+}
+
+bool hub_bus_poll(HubBusSub *sub, HubBusEvent *out)
+{
+    if (!sub || !out) return false;
+    while (1) {
+        uint64_t h = atomic_load_explicit(&sub->head, memory_order_acquire);
+        HubBusSlot *slot = &sub->ring[h & (sub->cap - 1)];
+        if (atomic_load_explicit(&slot->stamp, memory_order_acquire) != h + 1) {
+            return false;
+        }
+        // Claim position h before touching the slot. A drop-oldest
+        // publisher may claim it first; then retry with the new head.
+        if (!atomic_compare_exchange_weak(&sub->head, &h, h + 1)) continue;
+        *out = slot->ev;
+        atomic_store_explicit(&slot->stamp, h + sub->cap, memory_order_release);
+        return true;
+    }
+}
+
+void hub_bus_clear(HubBusSub *sub)
+{
+    uint64_t v;
+    ssize_t n = read(sub->efd, &v, sizeof(v));
+    (void)n;
+}
+
+bool hub_bus_wait(HubBusSub *sub, HubBusEvent *out, int timeout_ms)
+{
+    if (!sub || !out) return false;
+    while (!atomic_load(&sub->wake)) {
+        if (hub_bus_poll(sub, out)) return true;
+
+        struct pollfd pfd = { .fd = sub->efd, .events = POLLIN };
+        int r = poll(&pfd, 1, timeout_ms);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (r == 0) return false;
+        hub_bus_clear(sub);
+    }
+    atomic_store(&sub->wake, false);
+    return false;
+}
+
+void hub_bus_wake(HubBusSub *sub)
+{
+    if (!sub) return;
+    atomic_store(&sub->wake, true);
+    signal_fd(sub->efd);
+}
+
+int hub_bus_fd(const HubBusSub *sub)
+{
+    return sub ? sub->efd : -1;
+}
+
+uint64_t hub_bus_dropped(const HubBusSub *sub)
+{
+    return sub ? atomic_load(&sub->dropped) : 0;
+}
+
+void hub_bus_get_stats(HubBusStats *out)
+{
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    for (int i = 0; i < HUB_EV_TYPE_COUNT; i++) {
+        out->published[i] = atomic_load(&g_published[i]);
+    }
+    pthread_mutex_lock(&g_pub_lock);
+    for (int i = 0; i < HUB_BUS_MAX_SUBS; i++) {
+        HubBusSub *s = &g_subs[i];
+        if (!s->in_use) continue;
+        int n = out->num_subs++;
+        snprintf(out->subs[n].name, sizeof(out->subs[n].name), "%s", s->name);
+        out->subs[n].depth = (int)(atomic_load(&s->tail) - atomic_load(&s->head));
+        out->subs[n].capacity = (int)s->cap;
+        out->subs[n].dropped = atomic_load(&s->dropped);
+    }
+    pthread_mutex_unlock(&g_pub_lock);
+}
@@ -7,16 +7,20 @@
 #include "hal/led.h"
 #include "hal/led_worker.h"
 #include <errno.h>
+#include <stdatomic.h>
 #include <netinet/in.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <time.h>
 #include <unistd.h>
 #include "discord_alert.h"
+#include "hal/system_webhook.h"
+#include "hal/hub_bus.h"
 
-#define HUB_OFFLINE_TIMEOUT_MS 10000  // 10 seconds without heartbeat = offline
+#define HUB_OFFLINE_TIMEOUT_MS 10000  // 10 seconds without a packet = offline
 #define HUB_MAX_MODULES 16           // max distinct door modules to track
 
 // ---------- Endpoint table (door module -> last known IP:port) ----------
@@ -34,6 +38,7 @@ static int g_num_endpoints = 0;
 
 static int          g_sock        = -1;
 static int          g_sock2       = -1;
+static int          g_wake_fd     = -1;   // eventfd: new command in flight
 static pthread_t    g_thread_id;
 static int          g_listen_port = 0;
 static volatile int g_stopping    = 0;
@@ -53,10 +58,41 @@ static HubEvent g_history[HUB_MAX_HISTORY];
 static int      g_hist_head = 0; // next slot to write
 static int      g_hist_count = 0;
 
-// Track pending commands from clients so we can relay FEEDBACK back to them
+// History sequence; also the sequence of every published bus event
+static uint64_t g_hist_seq = 0;
+
+// Per-module secondary index over the history: the seqs of each module's
+// entries, oldest first. A module's ring is as long as the history, so it
+// holds every entry of that module the history still has. When all slots
+// are taken the module written longest ago is evicted; below
+// g_hist_evicted_max the index may be incomplete and queries scan instead.
+#define HUB_HIST_INDEX_MODULES (2 * HUB_MAX_DOORS)
+typedef struct {
+    char     module_id[HUB_MODULE_ID_LEN];
+    uint64_t seqs[HUB_MAX_HISTORY];
+    int      head;    // next slot to write
+    int      count;
+} HistIndex;
+static HistIndex g_hist_index[HUB_HIST_INDEX_MODULES];
+static uint64_t  g_hist_evicted_max = 0;
+
+// Bumped (under g_mutex) whenever anything in g_doors changes; read
+// without the lock by hub_udp_state_version().
+static _Atomic uint64_t g_state_version = 0;
+
+// Alert subscriber: turns bus transitions into webhook alerts off the
+// UDP thread and outside g_mutex.
+static HubBusSub   *g_alert_sub = NULL;
+static pthread_t    g_alert_thread;
+
+// Track pending commands from clients so we can relay FEEDBACK back to them.
+// A relayed command goes to the module under a hub cmdid from the same
+// counter as the hub's own commands, so the module never sees two
+// originators' commands with one cmdid.
 #define HUB_MAX_PENDING_CMDS 128
 typedef struct {
-    int cmdid;
+    int cmdid;                      // sent to the module; 0 = free
+    int client_cmdid;               // the client's own id, used in its FEEDBACK
     struct sockaddr_in client_addr;
     char module_id[HUB_MODULE_ID_LEN];
     long long issued_ms;
@@ -94,7 +130,13 @@ static void trigger_discord_alert(const char* module_id, const char* event_type,
     char alert_msg[256];
     snprintf(alert_msg, sizeof(alert_msg), 
              "[%s] %s %s is now %s", module_id, door, event_type, state);
-    sendDiscordAlert(g_webhook_url, alert_msg);
+    // Prefer the spooled/retrying webhook queue; fall back to a direct
+    // send only when the webhook worker isn't running.
+    if (hub_webhook_is_running()) {
+        hub_webhook_send(alert_msg);
+    } else {
+        sendDiscordAlert(g_webhook_url, alert_msg);
+    }
 }
 
 // ---------- door status helpers ----------
@@ -121,12 +163,24 @@ static HubDoorStatus *find_or_create_door(const char *module_id)
 
 // ---------- pending client-command map ----------
 
-static void register_client_command(int cmdid, const char *module_id,
-                                    struct sockaddr_in *client_addr)
+// Map a client's command to the hub cmdid it is forwarded under and return
+// that. A resend of a command still pending keeps its hub cmdid, so the
+// module recognizes it as a duplicate. Call with g_mutex held.
+static int register_client_command(int client_cmdid, const char *module_id,
+                                   struct sockaddr_in *client_addr)
 {
     int slot = 0;
     long long oldest_ms = g_pending_cmds[0].issued_ms;
 
+    for (int i = 0; i < HUB_MAX_PENDING_CMDS; i++) {
+        PendingClientCmd *p = &g_pending_cmds[i];
+        if (p->cmdid != 0 && p->client_cmdid == client_cmdid &&
+            p->client_addr.sin_addr.s_addr == client_addr->sin_addr.s_addr &&
+            p->client_addr.sin_port == client_addr->sin_port &&
+            strncmp(p->module_id, module_id, HUB_MODULE_ID_LEN) == 0) {
+            return p->cmdid;
+        }
+    }
     for (int i = 0; i < HUB_MAX_PENDING_CMDS; i++) {
         if (g_pending_cmds[i].cmdid == 0) {
             slot = i;
@@ -138,16 +192,19 @@ static void register_client_command(int cmdid, const char *module_id,
         }
     }
 
-    g_pending_cmds[slot].cmdid = cmdid;
+    g_pending_cmds[slot].cmdid = g_next_cmdid++;
+    g_pending_cmds[slot].client_cmdid = client_cmdid;
     g_pending_cmds[slot].client_addr = *client_addr;
     snprintf(g_pending_cmds[slot].module_id,
              sizeof(g_pending_cmds[slot].module_id), "%s", module_id);
     g_pending_cmds[slot].issued_ms = now_ms();
+    return g_pending_cmds[slot].cmdid;
 }
 
-// Lookup and remove a client command by module_id and cmdid
+// Lookup and remove a client command by module_id and hub cmdid; stores
+// the client's own cmdid in *client_cmdid.
 static struct sockaddr_in *get_and_clear_client_cmd(const char *module_id,
-                                                    int cmdid)
+                                                    int cmdid, int *client_cmdid)
 {
     for (int i = 0; i < HUB_MAX_PENDING_CMDS; i++) {
         if (g_pending_cmds[i].cmdid == cmdid &&
@@ -155,6 +212,7 @@ static struct sockaddr_in *get_and_clear_client_cmd(const char *module_id,
                     HUB_MODULE_ID_LEN) == 0) {
             static struct sockaddr_in result;
             result = g_pending_cmds[i].client_addr;
+            *client_cmdid = g_pending_cmds[i].client_cmdid;
             g_pending_cmds[i].cmdid = 0; // free
             return &result;
         }
@@ -162,11 +220,57 @@ static struct sockaddr_in *get_and_clear_client_cmd(const char *module_id,
     return NULL;
 }
 
-// ---------- history ----------
+// ---------- history / event publication ----------
 
-static void add_history(const char *module_id, const char *line, long long t)
+static HistIndex *hist_index_find(const char *module_id)
+{
+    for (int i = 0; i < HUB_HIST_INDEX_MODULES; i++) {
+        HistIndex *x = &g_hist_index[i];
+        if (x->count > 0 && strcmp(x->module_id, module_id) == 0) return x;
+    }
+    return NULL;
+}
+
+static uint64_t hist_index_newest(const HistIndex *x)
+{
+    return x->seqs[(x->head - 1 + HUB_MAX_HISTORY) % HUB_MAX_HISTORY];
+}
+
+// seq of the i-th oldest indexed entry
+static uint64_t hist_index_at(const HistIndex *x, int i)
+{
+    return x->seqs[(x->head - x->count + i + HUB_MAX_HISTORY) % HUB_MAX_HISTORY];
+}
+
+static void hist_index_add(const char *module_id, uint64_t seq)
+{
+    HistIndex *x = hist_index_find(module_id);
+    if (!x) {
+        x = &g_hist_index[0];
+        for (int i = 0; i < HUB_HIST_INDEX_MODULES; i++) {
+            HistIndex *y = &g_hist_index[i];
+            if (y->count == 0) { x = y; break; }
+            if (hist_index_newest(y) < hist_index_newest(x)) x = y;
+        }
+        if (x->count > 0 && hist_index_newest(x) > g_hist_evicted_max) {
+            g_hist_evicted_max = hist_index_newest(x);
+        }
+        snprintf(x->module_id, sizeof(x->module_id), "%s", module_id);
+        x->head = 0;
+        x->count = 0;
+    }
+    x->seqs[x->head] = seq;
+    x->head = (x->head + 1) % HUB_MAX_HISTORY;
+    if (x->count < HUB_MAX_HISTORY) x->count++;
+}
+
+// Append to the history ring; returns the entry's sequence number.
+static uint64_t add_history(const char *module_id, HubEventType type,
+                            const char *line, long long t)
 {
     HubEvent *e = &g_history[g_hist_head];
+    e->seq = ++g_hist_seq;
+    e->type = (int)type;
     e->timestamp_ms = t;
     snprintf(e->module_id, sizeof(e->module_id), "%s", module_id);
     snprintf(e->line, sizeof(e->line), "%s", line);
@@ -175,6 +279,271 @@ static void add_history(const char *module_id, const char *line, long long t)
     if (g_hist_count < HUB_MAX_HISTORY) {
         g_hist_count++;
     }
+    hist_index_add(e->module_id, e->seq);
+    return e->seq;
+}
+
+// Record `ev` in the history and publish it on the bus exactly once.
+// Call with g_mutex held so history order matches bus order.
+static void publish_event(HubBusEvent *ev, const char *line)
+{
+    ev->seq = add_history(ev->module_id, ev->type, line, ev->timestamp_ms);
+    hub_bus_publish(ev);
+}
+
+static HubBusEvent make_event(HubEventType type, const char *module_id,
+                              long long t)
+{
+    HubBusEvent ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = type;
+    ev.timestamp_ms = t;
+    snprintf(ev.module_id, sizeof(ev.module_id), "%s", module_id);
+    return ev;
+}
+
+// Publish a DOOR/LOCK transition for `channel` if `*field` changes.
+// Returns true if it did.
+static bool set_channel_state(const char *module_id, long long t,
+                              HubEventType type, const char *channel,
+                              bool *field, bool value)
+{
+    if (*field == value) return false;
+    *field = value;
+
+    HubBusEvent ev = make_event(type, module_id, t);
+    snprintf(ev.channel, sizeof(ev.channel), "%s", channel);
+    ev.state = value;
+
+    char line[HUB_LINE_LEN];
+    if (type == HUB_EV_DOOR) {
+        snprintf(line, sizeof(line), "%s EVENT %s DOOR %s",
+                 module_id, channel, value ? "OPEN" : "CLOSED");
+    } else {
+        snprintf(line, sizeof(line), "%s EVENT %s LOCK %s",
+                 module_id, channel, value ? "LOCKED" : "UNLOCKED");
+    }
+    publish_event(&ev, line);
+    return true;
+}
+
+// ---------- hub-issued commands in flight ----------
+
+// Commands issued by the hub itself (CLI, HTTP API) are sent from the main
+// socket and retransmitted by udp_thread until the module answers or the
+// attempts run out. A module answers ACCEPTED as soon as it has queued the
+// command and FEEDBACK once it has run it; after ACCEPTED the command is
+// only re-sent every HUB_CMD_POLL_MS (the module answers a duplicate with
+// ACCEPTED again, or with the FEEDBACK it sent if that got lost) until
+// FEEDBACK arrives or HUB_CMD_RUN_TIMEOUT_MS passes. The outcome is
+// published once as a HUB_EV_COMMAND_RESULT event carrying the same cmdid:
+// acked; failed without an answer; superseded when the module dropped a
+// queued LOCK or UNLOCK for a newer one; or aborted when the module shut
+// down before running it.
+#define HUB_CMD_POLL_MS        2000
+#define HUB_MAX_INFLIGHT       32
+
+typedef struct {
+    int cmdid;                      // 0 = free slot
+    char module_id[HUB_MODULE_ID_LEN];
+    char target[32];
+    char action[32];
+    struct sockaddr_in dest;
+    long long issued_ms;
+    long long next_tx_ms;
+    int attempts;
+    long long accepted_ms;          // 0 until the module sends ACCEPTED
+    int result;                     // 0 pending, 1 acked, -1 failed,
+                                    // -2 superseded, -3 aborted
+    int rtt_ms;
+    bool waited;                    // hub_udp_send_command() collects it
+} HubInflightCmd;
+
+static HubInflightCmd g_inflight[HUB_MAX_INFLIGHT];
+
+static void transmit_command(HubInflightCmd *c, long long now)
+{
+    char buf[256];
+    int len = snprintf(buf, sizeof(buf), "%s COMMAND %d %s %s\n",
+                       c->module_id, c->cmdid, c->target, c->action);
+    // MSG_DONTWAIT: a full socket buffer costs one attempt instead of
+    // stalling with g_mutex held.
+    if (g_sock < 0 ||
+        sendto(g_sock, buf, (size_t)len, MSG_DONTWAIT,
+               (struct sockaddr *)&c->dest, sizeof(c->dest)) != len) {
+        fprintf(stderr, "[hub_udp] COMMAND %d to %s not sent (attempt %d)\n",
+                c->cmdid, c->module_id, c->attempts + 1);
+    }
+    c->attempts++;
+    c->next_tx_ms = now + HUB_CMD_ACK_TIMEOUT_MS;
+}
+
+// Settle an in-flight command with `result` (as in HubInflightCmd) and
+// publish it with the module's `feedback` action (NULL if none came).
+// Call with g_mutex held.
+static void finish_command(HubInflightCmd *c, int result,
+                           const char *feedback, long long now)
+{
+    bool acked = (result > 0);
+    c->result = result;
+    c->rtt_ms = (int)(now - c->issued_ms);
+
+    HubBusEvent ev = make_event(HUB_EV_COMMAND_RESULT, c->module_id, now);
+    ev.cmdid  = c->cmdid;
+    ev.state  = acked;
+    ev.rtt_ms = c->rtt_ms;
+    snprintf(ev.feedback, sizeof(ev.feedback), "%s", feedback ? feedback : "");
+    if (!acked) {
+        snprintf(ev.reason, sizeof(ev.reason), "%s",
+                 result == -2 ? "superseded" : result == -3 ? "aborted" : "no_ack");
+    }
+    snprintf(ev.target, sizeof(ev.target), "%s", c->target);
+    snprintf(ev.action, sizeof(ev.action), "%s", c->action);
+    char line[HUB_LINE_LEN];
+    snprintf(line, sizeof(line), "%s RESULT %d %s %s %s %dms", c->module_id,
+             c->cmdid, c->target, c->action,
+             acked ? "ACKED" : result == -2 ? "SUPERSEDED" :
+             result == -3 ? "ABORTED" : "FAILED",
+             c->rtt_ms);
+    publish_event(&ev, line);
+
+    if (acked) {
+        LED_enqueue_hub_command_success();
+    } else if (result == -2) {
+        // the module is fine; the newer command reports the move
+        LED_enqueue_blink_red_n(2, 2, 50);
+    } else {
+        LED_enqueue_blink_red_n(5, 2, 50);
+        LED_enqueue_status_network_error();
+    }
+
+    if (!c->waited) c->cmdid = 0;
+    pthread_cond_broadcast(&g_feedback_cond);
+}
+
+// How a FEEDBACK action settles `c`: -2 for <ACTION>_SUPERSEDED, -3 for
+// <ACTION>_ABORTED, otherwise 1 if it answers it (STATUS is answered as
+// STATUS_<STATE>, so an action also matches its own name followed by
+// '_'), 0 if it is not for `c`.
+static int feedback_result(const HubInflightCmd *c,
+                           const char *target, const char *action)
+{
+    size_t alen = strlen(c->action);
+    if (strcmp(c->target, target) != 0 ||
+        strncmp(c->action, action, alen) != 0) {
+        return 0;
+    }
+    const char *rest = action + alen;
+    if (strcmp(rest, "_SUPERSEDED") == 0) return -2;
+    if (strcmp(rest, "_ABORTED") == 0) return -3;
+    return (*rest == '\0' || *rest == '_') ? 1 : 0;
+}
+
+// Match a module FEEDBACK against the in-flight table. Call with g_mutex held.
+static void complete_command(const char *module_id, int cmdid,
+                             const char *target, const char *action,
+                             long long now)
+{
+    for (int i = 0; i < HUB_MAX_INFLIGHT; i++) {
+        HubInflightCmd *c = &g_inflight[i];
+        if (c->cmdid != cmdid || c->result != 0 ||
+            strcmp(c->module_id, module_id) != 0) {
+            continue;
+        }
+        int result = feedback_result(c, target, action);
+        if (result != 0) {
+            finish_command(c, result, action, now);
+            return;
+        }
+    }
+}
+
+// Next wake-up for an accepted command: the next poll, or its run
+// deadline if that comes first, so it fails on time.
+static void schedule_poll(HubInflightCmd *c, long long now)
+{
+    long long deadline = c->accepted_ms + HUB_CMD_RUN_TIMEOUT_MS;
+    c->next_tx_ms = now + HUB_CMD_POLL_MS;
+    if (c->next_tx_ms > deadline) c->next_tx_ms = deadline;
+}
+
+// The module queued the command; wait for FEEDBACK. Call with g_mutex held.
+static void accept_command(const char *module_id, int cmdid,
+                           const char *target, const char *action,
+                           long long now)
+{
+    for (int i = 0; i < HUB_MAX_INFLIGHT; i++) {
+        HubInflightCmd *c = &g_inflight[i];
+        if (c->cmdid == cmdid && c->result == 0 &&
+            strcmp(c->module_id, module_id) == 0 &&
+            strcmp(c->target, target) == 0 && strcmp(c->action, action) == 0) {
+            if (c->accepted_ms == 0) c->accepted_ms = now;
+            schedule_poll(c, now);
+            return;
+        }
+    }
+}
+
+// Retransmit or fail overdue commands. Returns the number of ms until the
+// next retransmit deadline, capped at max_wait_ms.
+static int service_commands(int max_wait_ms)
+{
+    long long now = now_ms();
+    int wait_ms = max_wait_ms;
+
+    pthread_mutex_lock(&g_mutex);
+    for (int i = 0; i < HUB_MAX_INFLIGHT; i++) {
+        HubInflightCmd *c = &g_inflight[i];
+        if (c->cmdid == 0 || c->result != 0) continue;
+        if (now >= c->next_tx_ms) {
+            if (c->accepted_ms) {
+                if (now - c->accepted_ms >= HUB_CMD_RUN_TIMEOUT_MS) {
+                    finish_command(c, -1, NULL, now);
+                    continue;
+                }
+                transmit_command(c, now);
+                schedule_poll(c, now);
+            } else if (c->attempts >= HUB_CMD_ATTEMPTS) {
+                finish_command(c, -1, NULL, now);
+                continue;
+            } else {
+                transmit_command(c, now);
+            }
+        }
+        long long left = c->next_tx_ms - now;
+        if (left < wait_ms) wait_ms = (int)left;
+    }
+    pthread_mutex_unlock(&g_mutex);
+    return wait_ms;
+}
+
+// ---------- alert subscriber ----------
+
+static void *alert_thread(void *arg)
+{
+    (void)arg;
+    HubBusEvent ev;
+    while (hub_bus_wait(g_alert_sub, &ev, -1)) {
+        switch (ev.type) {
+            case HUB_EV_DOOR:
+                trigger_discord_alert(ev.module_id, "DOOR", ev.channel,
+                                      ev.state ? "OPEN" : "CLOSED");
+                break;
+            case HUB_EV_LOCK:
+                trigger_discord_alert(ev.module_id, "LOCK", ev.channel,
+                                      ev.state ? "LOCKED" : "UNLOCKED");
+                break;
+            case HUB_EV_ONLINE:
+                trigger_discord_alert(ev.module_id, "SYSTEM", "MODULE", "ONLINE");
+                break;
+            case HUB_EV_OFFLINE:
+                trigger_discord_alert(ev.module_id, "SYSTEM", "MODULE", "OFFLINE");
+                break;
+            default:
+                break;
+        }
+    }
+    return NULL;
 }
 
 // ---------- parse helpers ----------
@@ -308,35 +677,38 @@ static void check_offline_modules(void)
     for (int i = 0; i < HUB_MAX_DOORS; i++) {
         if (!g_doors[i].known) continue;
 
+        // Heartbeats, EVENTs, FEEDBACK and HELLO all count: modules skip
+        // heartbeats right after other traffic and stretch them (up to a
+        // third of this budget) while their state is stable.
         bool should_be_offline =
-            (now - g_doors[i].last_heartbeat_ms) > HUB_OFFLINE_TIMEOUT_MS;
+            (now - g_doors[i].last_seen_ms) > HUB_OFFLINE_TIMEOUT_MS;
 
         if (should_be_offline && !g_doors[i].offline) {
             fprintf(stderr,
-                    "[hub_offline_check] Module %s went OFFLINE (no heartbeat for %lld ms)\n",
+                    "[hub_offline_check] Module %s went OFFLINE (silent for %lld ms)\n",
                     g_doors[i].module_id,
-                    now - g_doors[i].last_heartbeat_ms);
+                    now - g_doors[i].last_seen_ms);
             g_doors[i].offline = true;
             g_doors[i].last_online_ms = now;
+            g_doors[i].version = atomic_fetch_add(&g_state_version, 1) + 1;
 
-            char event[256];
+            char event[HUB_LINE_LEN];
             snprintf(event, sizeof(event),
-                     "%s EVENT SYSTEM OFFLINE\n", g_doors[i].module_id);
-            add_history(g_doors[i].module_id, event, now);
-            trigger_discord_alert(g_doors[i].module_id,
-                                  "SYSTEM", "MODULE", "OFFLINE");
+                     "%s EVENT SYSTEM OFFLINE", g_doors[i].module_id);
+            HubBusEvent ev = make_event(HUB_EV_OFFLINE, g_doors[i].module_id, now);
+            publish_event(&ev, event);
         } else if (!should_be_offline && g_doors[i].offline) {
             fprintf(stderr,
                     "[hub_offline_check] Module %s came back ONLINE\n",
                     g_doors[i].module_id);
             g_doors[i].offline = false;
+            g_doors[i].version = atomic_fetch_add(&g_state_version, 1) + 1;
 
-            char event[256];
+            char event[HUB_LINE_LEN];
             snprintf(event, sizeof(event),
-                     "%s EVENT SYSTEM ONLINE\n", g_doors[i].module_id);
-            add_history(g_doors[i].module_id, event, now);
-            trigger_discord_alert(g_doors[i].module_id,
-                                  "SYSTEM", "MODULE", "ONLINE");
+                     "%s EVENT SYSTEM ONLINE", g_doors[i].module_id);
+            HubBusEvent ev = make_event(HUB_EV_ONLINE, g_doors[i].module_id, now);
+            publish_event(&ev, event);
         }
     }
     pthread_mutex_unlock(&g_mutex);
@@ -344,10 +716,22 @@ static void check_offline_modules(void)
 
 // ---------- line handler ----------
 
-static void handle_line(char *line, const char *raw,
-                        struct sockaddr_in *src, int fd)
+// Acknowledge a sequenced EVENT on the socket it arrived on, so the
+// module stops resending it. Call with g_mutex held.
+static void ack_event(const char *module_id, const char *seq_s,
+                      const struct sockaddr_in *src, int fd)
+{
+    if (!src || fd < 0) return;
+    char buf[64];
+    int len = snprintf(buf, sizeof(buf), "%s ACK %s\n", module_id, seq_s);
+    if (len > 0 && len < (int)sizeof(buf)) {
+        sendto(fd, buf, (size_t)len, MSG_DONTWAIT,
+               (const struct sockaddr *)src, sizeof(*src));
+    }
+}
+
+static void handle_line(char *line, struct sockaddr_in *src, int fd)
 {
-    (void)fd;
     long long t = now_ms();
 
     char *save = NULL;
@@ -366,7 +750,7 @@ static void handle_line(char *line, const char *raw,
 
     HubDoorStatus *door = find_or_create_door(mod);
     if (!door) {
-        add_history(mod, "<NO-STATE> (untracked)", t);
+        add_history(mod, 0, "<NO-STATE> (untracked)", t);
         pthread_mutex_unlock(&g_mutex);
         return;
     }
@@ -377,20 +761,22 @@ static void handle_line(char *line, const char *raw,
     if (src && strcmp(type, "COMMAND") != 0) {
         door->last_addr = *src;
         door->has_last_addr = 1;
+        door->last_seen_ms = t;
     }
 
     char hist_line[HUB_LINE_LEN];
     snprintf(hist_line, sizeof(hist_line), "%s %s", mod, type);
-    add_history(mod, hist_line, t);
 
     if (strcmp(type, "HEARTBEAT") == 0) {
         char *tok = NULL;
         char hb_buf[HUB_LINE_LEN] = {0};
+        bool d0_open = door->d0_open, d0_locked = door->d0_locked;
+        bool d1_open = door->d1_open, d1_locked = door->d1_locked;
         while ((tok = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
             if (strncmp(tok, "D0=", 3) == 0) {
-                parse_d_state(tok, &door->d0_open, &door->d0_locked);
+                parse_d_state(tok, &d0_open, &d0_locked);
             } else if (strncmp(tok, "D1=", 3) == 0) {
-                parse_d_state(tok, &door->d1_open, &door->d1_locked);
+                parse_d_state(tok, &d1_open, &d1_locked);
             }
             if (hb_buf[0] != '\0')
                 strncat(hb_buf, " ",
@@ -406,11 +792,42 @@ static void handle_line(char *line, const char *raw,
             snprintf(door->last_heartbeat_line,
                      sizeof(door->last_heartbeat_line), "%s", hist_line);
         }
+
+        HubBusEvent ev = make_event(HUB_EV_HEARTBEAT, mod, t);
+        char hb_line[HUB_LINE_LEN];
+        snprintf(hb_line, sizeof(hb_line), "%s HEARTBEAT %.200s", mod, hb_buf);
+        publish_event(&ev, hb_line);
+
+        // Modules report the door on D0 and the lock on D1; the other two
+        // tokens mirror them, so only those two produce transitions.
+        set_channel_state(mod, t, HUB_EV_DOOR, "D0", &door->d0_open, d0_open);
+        set_channel_state(mod, t, HUB_EV_LOCK, "D1", &door->d1_locked, d1_locked);
+        door->d0_locked = d0_locked;
+        door->d1_open   = d1_open;
     } else if (strcmp(type, "EVENT") == 0) {
         char *which = strtok_r(NULL, " \t\r\n", &save);
         char *what  = strtok_r(NULL, " \t\r\n", &save);
         char *state = strtok_r(NULL, " \t\r\n", &save);
-        if (which && what && state) {
+        char *seq_s = strtok_r(NULL, " \t\r\n", &save);
+        bool stale = false;
+        bool published = false;
+        if (which && what && state && seq_s) {
+            // Sequenced EVENT: always ack, apply only if newer than the
+            // last one applied on its channel (wrap-around compare).
+            uint32_t seq = (uint32_t)strtoul(seq_s, NULL, 10);
+            ack_event(mod, seq_s, src, fd);
+            int ch = strcmp(which, "D0") == 0 ? 0 :
+                     strcmp(which, "D1") == 0 ? 1 : -1;
+            if (ch >= 0) {
+                stale = door->has_event_seq[ch] &&
+                        (int32_t)(seq - door->last_event_seq[ch]) <= 0;
+                if (!stale) {
+                    door->has_event_seq[ch] = true;
+                    door->last_event_seq[ch] = seq;
+                }
+            }
+        }
+        if (which && what && state && !stale) {
             bool *p_open  = NULL;
             bool *p_locked= NULL;
 
@@ -425,23 +842,31 @@ static void handle_line(char *line, const char *raw,
             if (p_open && p_locked) {
                 if (strcmp(what, "DOOR") == 0) {
                     if (strcmp(state, "OPEN") == 0) {
-                        *p_open = true;
-                        trigger_discord_alert(mod, what, which, state);
+                        published = set_channel_state(mod, t, HUB_EV_DOOR, which, p_open, true);
                     } else if (strcmp(state, "CLOSED") == 0) {
-                        *p_open = false;
-                        trigger_discord_alert(mod, what, which, state);
+                        published = set_channel_state(mod, t, HUB_EV_DOOR, which, p_open, false);
                     }
                 } else if (strcmp(what, "LOCK") == 0) {
                     if (strcmp(state, "LOCKED") == 0) {
-                        *p_locked = true;
-                        trigger_discord_alert(mod, what, which, state);
+                        published = set_channel_state(mod, t, HUB_EV_LOCK, which, p_locked, true);
                     } else if (strcmp(state, "UNLOCKED") == 0) {
-                        *p_locked = false;
-                        trigger_discord_alert(mod, what, which, state);
+                        published = set_channel_state(mod, t, HUB_EV_LOCK, which, p_locked, false);
                     }
                 }
             }
         }
+        // An EVENT that changed nothing (repeat, stale or unknown) is
+        // still kept in the history, just not published as a transition.
+        if (!published) {
+            char ev_line[HUB_LINE_LEN];
+            if (which && what && state) {
+                snprintf(ev_line, sizeof(ev_line), "%s EVENT %.16s %.16s %.16s",
+                         mod, which, what, state);
+            } else {
+                snprintf(ev_line, sizeof(ev_line), "%s", hist_line);
+            }
+            add_history(mod, 0, ev_line, t);
+        }
         door->last_event_ms = t;
     } else if (strcmp(type, "FEEDBACK") == 0) {
         char *cmdid_s = strtok_r(NULL, " \t\r\n", &save);
@@ -457,18 +882,23 @@ static void handle_line(char *line, const char *raw,
             door->last_feedback_ms    = t;
             door->last_feedback_cmdid = cmdid;
 
+            HubBusEvent ev = make_event(HUB_EV_FEEDBACK, mod, t);
+            ev.cmdid = cmdid;
+            snprintf(ev.target, sizeof(ev.target), "%s", target);
+            snprintf(ev.action, sizeof(ev.action), "%s", action);
             char fbline[HUB_LINE_LEN];
             snprintf(fbline, sizeof(fbline),
-                     "FEEDBACK %d %s %s", cmdid, target, action);
-            add_history(mod, fbline, t);
+                     "%s FEEDBACK %d %s %s", mod, cmdid, target, action);
+            publish_event(&ev, fbline);
 
+            int client_cmdid = 0;
             struct sockaddr_in *client_addr =
-                get_and_clear_client_cmd(mod, cmdid);
+                get_and_clear_client_cmd(mod, cmdid, &client_cmdid);
             if (client_addr) {
                 char relay_msg[256];
                 snprintf(relay_msg, sizeof(relay_msg),
                          "%s FEEDBACK %d %s %s\n",
-                         mod, cmdid, target, action);
+                         mod, client_cmdid, target, action);
 
                 pthread_mutex_unlock(&g_mutex);
                 int relay_sock = socket(AF_INET, SOCK_DGRAM, 0);
@@ -481,7 +911,16 @@ static void handle_line(char *line, const char *raw,
                 pthread_mutex_lock(&g_mutex);
             }
 
-            pthread_cond_broadcast(&g_feedback_cond);
+            complete_command(mod, cmdid, target, action, t);
+        }
+    } else if (strcmp(type, "ACCEPTED") == 0) {
+        // ACCEPTED <CMDID> <TARGET> <ACTION>: queued on the module,
+        // FEEDBACK follows when it has run
+        char *cmdid_s = strtok_r(NULL, " \t\r\n", &save);
+        char *target  = strtok_r(NULL, " \t\r\n", &save);
+        char *action  = strtok_r(NULL, " \t\r\n", &save);
+        if (cmdid_s && target && action) {
+            accept_command(mod, atoi(cmdid_s), target, action, t);
         }
     } else if (strcmp(type, "COMMAND") == 0) {
         // COMMAND <CMDID> <TARGET> <ACTION> from Node → forward to door
@@ -491,19 +930,49 @@ static void handle_line(char *line, const char *raw,
 
         if (cmdid_s && src && target && action) {
             int client_cmdid = atoi(cmdid_s);
-            register_client_command(client_cmdid, mod, src);
-
-            // Forward the ORIGINAL line (raw) to the module, so the
-            // cmdid stays the same from Node → door → FEEDBACK
+            int cmdid = register_client_command(client_cmdid, mod, src);
+
+            HubBusEvent ev = make_event(HUB_EV_COMMAND, mod, t);
+            ev.cmdid = cmdid;
+            snprintf(ev.target, sizeof(ev.target), "%s", target);
+            snprintf(ev.action, sizeof(ev.action), "%s", action);
+            char cmdline[HUB_LINE_LEN];
+            snprintf(cmdline, sizeof(cmdline), "%s COMMAND %d %s %s",
+                     mod, cmdid, target, action);
+            publish_event(&ev, cmdline);
+
+            // Forward under the hub cmdid; the FEEDBACK is relayed back
+            // with the client's.
+            char fwd[HUB_LINE_LEN + 1];
+            snprintf(fwd, sizeof(fwd), "%s\n", cmdline);
             pthread_mutex_unlock(&g_mutex);
-            hub_forward_command_to_module(mod, raw);
+            hub_forward_command_to_module(mod, fwd);
             pthread_mutex_lock(&g_mutex);
         }
+    } else if (strcmp(type, "HELLO") == 0) {
+        door->last_event_ms = t;
+        // the module (re)started
+        door->has_event_seq[0] = door->has_event_seq[1] = false;
+        // Tell the module how long we wait before calling it offline, so
+        // it can stretch its heartbeats to fit.
+        if (src && fd >= 0) {
+            char reply[64];
+            int len = snprintf(reply, sizeof(reply), "%s HELLO %d\n",
+                               mod, HUB_OFFLINE_TIMEOUT_MS);
+            sendto(fd, reply, (size_t)len, MSG_DONTWAIT,
+                   (struct sockaddr *)src, sizeof(*src));
+        }
+        HubBusEvent ev = make_event(HUB_EV_HELLO, mod, t);
+        publish_event(&ev, hist_line);
     } else {
-        // HELLO or unknown, just history+timestamp
+        // unknown, just history+timestamp
         door->last_event_ms = t;
+        add_history(mod, 0, hist_line, t);
     }
 
+    // Every packet from a tracked module touches its status (at least the
+    // timestamps and source address).
+    door->version = atomic_fetch_add(&g_state_version, 1) + 1;
     pthread_mutex_unlock(&g_mutex);
 }
 
@@ -518,7 +987,6 @@ static void *udp_thread(void *arg)
     struct sockaddr_in src;
     socklen_t src_len = sizeof(src);
     char buf[HUB_LINE_LEN];
-    char raw[HUB_LINE_LEN];
 
     while (!g_stopping) {
         fd_set rfds;
@@ -529,9 +997,15 @@ static void *udp_thread(void *arg)
             FD_SET(g_sock2, &rfds);
             if (g_sock2 > maxfd) maxfd = g_sock2;
         }
+        if (g_wake_fd >= 0) {
+            FD_SET(g_wake_fd, &rfds);
+            if (g_wake_fd > maxfd) maxfd = g_wake_fd;
+        }
 
+        // Sleep until the next command retransmit is due (at most 1 s).
+        int wait_ms = service_commands(1000);
         struct timeval tv;
-        tv.tv_sec = 1; tv.tv_usec = 0;
+        tv.tv_sec = wait_ms / 1000; tv.tv_usec = (wait_ms % 1000) * 1000;
         int r = select(maxfd + 1, &rfds, NULL, NULL, &tv);
         if (r < 0) {
             if (errno == EINTR) continue;
@@ -543,6 +1017,12 @@ static void *udp_thread(void *arg)
             continue;
         }
 
+        if (g_wake_fd >= 0 && FD_ISSET(g_wake_fd, &rfds)) {
+            uint64_t v;
+            ssize_t n = read(g_wake_fd, &v, sizeof(v));
+            (void)n;
+        }
+
         int fd = -1;
         if (g_sock >= 0 && FD_ISSET(g_sock, &rfds)) fd = g_sock;
         else if (g_sock2 >= 0 && FD_ISSET(g_sock2, &rfds)) fd = g_sock2;
@@ -561,7 +1041,6 @@ static void *udp_thread(void *arg)
             }
             if (n == 0) break;
             buf[n] = '\0';
-            memcpy(raw, buf, n + 1);
 
             char src_ip[INET_ADDRSTRLEN];
             inet_ntop(AF_INET, &src.sin_addr, src_ip, INET_ADDRSTRLEN);
@@ -569,7 +1048,7 @@ static void *udp_thread(void *arg)
                     "[hub_udp_thread] RECEIVED: %zd bytes from %s:%u on fd=%d: '%s'\n",
                     n, src_ip, ntohs(src.sin_port), fd, buf);
 
-            handle_line(buf, raw, &src, fd);
+            handle_line(buf, &src, fd);
         }
 
         check_offline_modules();
@@ -655,6 +1134,11 @@ bool hub_udp_init(uint16_t listen_port1, uint16_t listen_port2)
         g_sock2 = s2;
     }
 
+    g_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (g_wake_fd < 0) {
+        perror("[hub_udp_init] eventfd");
+    }
+
     g_stopping = 0;
 
     pthread_mutex_lock(&g_mutex);
@@ -662,10 +1146,26 @@ bool hub_udp_init(uint16_t listen_port1, uint16_t listen_port2)
     memset(g_history, 0, sizeof(g_history));
     g_hist_head  = 0;
     g_hist_count = 0;
+    g_hist_seq   = 0;
+    memset(g_hist_index, 0, sizeof(g_hist_index));
+    g_hist_evicted_max = 0;
+    memset(g_inflight, 0, sizeof(g_inflight));
+    atomic_fetch_add(&g_state_version, 1);
     memset(g_endpoints, 0, sizeof(g_endpoints));
     g_num_endpoints = 0;
     pthread_mutex_unlock(&g_mutex);
 
+    g_alert_sub = hub_bus_subscribe("alerts",
+                                    HUB_EV_DOOR | HUB_EV_LOCK |
+                                    HUB_EV_ONLINE | HUB_EV_OFFLINE,
+                                    64, HUB_BP_DROP_NEWEST);
+    if (!g_alert_sub ||
+        pthread_create(&g_alert_thread, NULL, alert_thread, NULL) != 0) {
+        fprintf(stderr, "[hub_udp_init] WARNING: alert subscriber not started\n");
+        hub_bus_unsubscribe(g_alert_sub);
+        g_alert_sub = NULL;
+    }
+
     fprintf(stderr, "[hub_udp_init] Creating listener thread...\n");
     if (pthread_create(&g_thread_id, NULL, udp_thread, NULL) != 0) {
         perror("[hub_udp_init] pthread_create");
@@ -673,7 +1173,8 @@ bool hub_udp_init(uint16_t listen_port1, uint16_t listen_port2)
                 "[hub_udp_init] ERROR: Failed to create listener thread\n");
         if (g_sock2 >= 0) close(g_sock2);
         if (g_sock  >= 0) close(g_sock);
-        g_sock = -1; g_sock2 = -1;
+        if (g_wake_fd >= 0) close(g_wake_fd);
+        g_sock = -1; g_sock2 = -1; g_wake_fd = -1;
         return false;
     }
     fprintf(stderr,
@@ -691,8 +1192,27 @@ void hub_udp_shutdown(void)
 
     g_stopping = 1;
     pthread_join(g_thread_id, NULL);
+
+    // Nothing will retransmit any more: fail what is still in flight so
+    // blocked callers and parked HTTP requests get their result.
+    pthread_mutex_lock(&g_mutex);
+    long long now = now_ms();
+    for (int i = 0; i < HUB_MAX_INFLIGHT; i++) {
+        if (g_inflight[i].cmdid != 0 && g_inflight[i].result == 0) {
+            finish_command(&g_inflight[i], -1, NULL, now);
+        }
+    }
+    pthread_mutex_unlock(&g_mutex);
+
     if (g_sock  >= 0) { close(g_sock);  g_sock  = -1; }
     if (g_sock2 >= 0) { close(g_sock2); g_sock2 = -1; }
+    if (g_wake_fd >= 0) { close(g_wake_fd); g_wake_fd = -1; }
+    if (g_alert_sub) {
+        hub_bus_wake(g_alert_sub);
+        pthread_join(g_alert_thread, NULL);
+        hub_bus_unsubscribe(g_alert_sub);
+        g_alert_sub = NULL;
+    }
     discordCleanup();
 }
 
@@ -715,6 +1235,44 @@ bool hub_udp_get_status(const char *module_id, HubDoorStatus *out)
     return found;
 }
 
+int hub_udp_get_all_status(HubDoorStatus *out, int max_doors,
+                           uint64_t *version)
+{
+    if (!out || max_doors <= 0) return 0;
+
+    int n = 0;
+    pthread_mutex_lock(&g_mutex);
+    for (int i = 0; i < HUB_MAX_DOORS && n < max_doors; i++) {
+        if (g_doors[i].known) out[n++] = g_doors[i];
+    }
+    if (version) *version = atomic_load(&g_state_version);
+    pthread_mutex_unlock(&g_mutex);
+    return n;
+}
+
+uint64_t hub_udp_state_version(void)
+{
+    return atomic_load(&g_state_version);
+}
+
+uint64_t hub_udp_status_version(const char *module_id)
+{
+    if (!module_id) return 0;
+
+    uint64_t version = 0;
+    pthread_mutex_lock(&g_mutex);
+    for (int i = 0; i < HUB_MAX_DOORS; i++) {
+        if (g_doors[i].known &&
+            strncmp(g_doors[i].module_id, module_id,
+                    HUB_MODULE_ID_LEN) == 0) {
+            version = g_doors[i].version;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_mutex);
+    return version;
+}
+
 int hub_udp_get_history(HubEvent *out, int max_events)
 {
     if (!out || max_events <= 0) return 0;
@@ -734,15 +1292,85 @@ int hub_udp_get_history(HubEvent *out, int max_events)
     return count;
 }
 
-// Existing hub_udp_send_command (used by hub CLI / internal code).
-// This now co-exists with the forwarding path used by Node commands.
-bool hub_udp_send_command(const char *module_id,
-                          const char *target, const char *action)
+int hub_udp_get_history_since(uint64_t after_seq, HubEvent *out,
+                              int max_events)
+{
+    if (!out || max_events <= 0) return 0;
+
+    pthread_mutex_lock(&g_mutex);
+    uint64_t oldest = g_hist_seq - (uint64_t)g_hist_count + 1;
+    uint64_t seq = (after_seq + 1 > oldest) ? after_seq + 1 : oldest;
+    int n = 0;
+    while (seq <= g_hist_seq && n < max_events) {
+        // The newest entry (g_hist_seq) sits just before g_hist_head.
+        int back = (int)(g_hist_seq - seq) + 1;
+        out[n++] = g_history[(g_hist_head - back + HUB_MAX_HISTORY) % HUB_MAX_HISTORY];
+        seq++;
+    }
+    pthread_mutex_unlock(&g_mutex);
+    return n;
+}
+
+uint64_t hub_udp_history_seq(void)
+{
+    pthread_mutex_lock(&g_mutex);
+    uint64_t seq = g_hist_seq;
+    pthread_mutex_unlock(&g_mutex);
+    return seq;
+}
+
+static const HubEvent *history_at(uint64_t seq)
 {
-    if (!module_id || !target || !action) return false;
+    int back = (int)(g_hist_seq - seq) + 1;
+    return &g_history[(g_hist_head - back + HUB_MAX_HISTORY) % HUB_MAX_HISTORY];
+}
 
-    const int ACK_TIMEOUT_MS = 500;
-    const int ACK_RETRIES    = 2;
+int hub_udp_visit_history(const char *module_id, uint32_t type_mask,
+                          uint64_t after_seq, HubHistoryFn fn, void *ctx,
+                          uint64_t *newest_seq)
+{
+    if (!fn) return 0;
+    bool by_module = module_id && module_id[0];
+
+    pthread_mutex_lock(&g_mutex);
+    uint64_t oldest = g_hist_seq - (uint64_t)g_hist_count + 1;
+    uint64_t from = (after_seq + 1 > oldest) ? after_seq + 1 : oldest;
+    if (newest_seq) *newest_seq = g_hist_seq;
+    int n = 0;
+
+    if (by_module && from > g_hist_evicted_max) {
+        const HistIndex *x = hist_index_find(module_id);
+        int lo = 0, hi = x ? x->count : 0;
+        while (lo < hi) {   // first indexed entry with seq >= from
+            int mid = (lo + hi) / 2;
+            if (hist_index_at(x, mid) < from) lo = mid + 1; else hi = mid;
+        }
+        for (int i = lo; x && i < x->count; i++) {
+            const HubEvent *e = history_at(hist_index_at(x, i));
+            if (type_mask && !(type_mask & (uint32_t)e->type)) continue;
+            n++;
+            if (!fn(e, ctx)) break;
+        }
+    } else {
+        for (uint64_t seq = from; seq <= g_hist_seq; seq++) {
+            const HubEvent *e = history_at(seq);
+            if (by_module && strcmp(e->module_id, module_id) != 0) continue;
+            if (type_mask && !(type_mask & (uint32_t)e->type)) continue;
+            n++;
+            if (!fn(e, ctx)) break;
+        }
+    }
+    pthread_mutex_unlock(&g_mutex);
+    return n;
+}
+
+// Queue a hub-issued command and send the first attempt. Returns the slot
+// index (and the cmdid in *out_cmdid), or -1 if the module has no route or
+// the table is full.
+static int submit_command(const char *module_id, const char *target,
+                          const char *action, bool waited, int *out_cmdid)
+{
+    if (!module_id || !target || !action || g_sock < 0) return -1;
 
     pthread_mutex_lock(&g_mutex);
     HubDoorStatus *door = NULL;
@@ -756,71 +1384,64 @@ bool hub_udp_send_command(const char *module_id,
     }
     if (!door || !door->has_last_addr) {
         pthread_mutex_unlock(&g_mutex);
-        return false;
+        return -1;
     }
 
-    struct sockaddr_in dest = door->last_addr;
-    int cmdid = g_next_cmdid++;
-    pthread_mutex_unlock(&g_mutex);
-
-    char buf[256];
-    snprintf(buf, sizeof(buf),
-             "%s COMMAND %d %s %s\n", module_id, cmdid, target, action);
-
-    int attempt = 0;
-    while (attempt <= ACK_RETRIES) {
-        int s = socket(AF_INET, SOCK_DGRAM, 0);
-        if (s < 0) {
-            attempt++;
-            sleepForMs(1);
-            continue;
-        }
-        ssize_t n = sendto(s, buf, strlen(buf), 0,
-                           (struct sockaddr *)&dest, sizeof(dest));
-        close(s);
-        if (n != (ssize_t)strlen(buf)) {
-            attempt++;
-            sleepForMs(20 * (1 << attempt));
-            continue;
-        }
+    int slot = -1;
+    for (int i = 0; i < HUB_MAX_INFLIGHT; i++) {
+        if (g_inflight[i].cmdid == 0) { slot = i; break; }
+    }
+    if (slot < 0) {
+        pthread_mutex_unlock(&g_mutex);
+        fprintf(stderr, "[hub_udp] Too many commands in flight; dropping %s %s\n",
+                module_id, action);
+        return -1;
+    }
 
-        struct timespec ts;
-        clock_gettime(CLOCK_REALTIME, &ts);
-        ts.tv_sec  += (ACK_TIMEOUT_MS / 1000);
-        ts.tv_nsec += (ACK_TIMEOUT_MS % 1000) * 1000000;
-        if (ts.tv_nsec >= 1000000000) {
-            ts.tv_sec += 1;
-            ts.tv_nsec -= 1000000000;
-        }
+    HubInflightCmd *c = &g_inflight[slot];
+    memset(c, 0, sizeof(*c));
+    c->cmdid = g_next_cmdid++;
+    snprintf(c->module_id, sizeof(c->module_id), "%s", module_id);
+    snprintf(c->target, sizeof(c->target), "%s", target);
+    snprintf(c->action, sizeof(c->action), "%s", action);
+    c->dest      = door->last_addr;
+    c->issued_ms = now_ms();
+    c->waited    = waited;
+    transmit_command(c, c->issued_ms);
+    if (out_cmdid) *out_cmdid = c->cmdid;
+    pthread_mutex_unlock(&g_mutex);
 
-        pthread_mutex_lock(&g_mutex);
-        int rc = 0;
-        while (door->last_feedback_cmdid < cmdid) {
-            rc = pthread_cond_timedwait(&g_feedback_cond, &g_mutex, &ts);
-            if (rc == ETIMEDOUT) break;
-        }
+    // Let udp_thread pick up the new retransmit deadline.
+    if (g_wake_fd >= 0) {
+        uint64_t one = 1;
+        ssize_t n = write(g_wake_fd, &one, sizeof(one));
+        (void)n;
+    }
+    return slot;
+}
 
-        bool got = false;
-        if (door->last_feedback_cmdid >= cmdid) {
-            if (strncmp(door->last_feedback_target, target,
-                        sizeof(door->last_feedback_target)) == 0 &&
-                strncmp(door->last_feedback_action, action,
-                        sizeof(door->last_feedback_action)) == 0) {
-                got = true;
-            }
-        }
-        pthread_mutex_unlock(&g_mutex);
+int hub_udp_submit_command(const char *module_id,
+                           const char *target, const char *action)
+{
+    int cmdid = -1;
+    if (submit_command(module_id, target, action, false, &cmdid) < 0) return -1;
+    return cmdid;
+}
 
-        if (got) {
-            LED_enqueue_hub_command_success();
-            return true;
-        }
+// Blocking wrapper around the in-flight table (used by the hub CLI).
+bool hub_udp_send_command(const char *module_id,
+                          const char *target, const char *action)
+{
+    int slot = submit_command(module_id, target, action, true, NULL);
+    if (slot < 0) return false;
 
-        attempt++;
-        sleepForMs(50 * attempt);
+    pthread_mutex_lock(&g_mutex);
+    HubInflightCmd *c = &g_inflight[slot];
+    while (c->result == 0) {
+        pthread_cond_wait(&g_feedback_cond, &g_mutex);
     }
-
-    LED_enqueue_blink_red_n(5, 2, 50);
-    LED_enqueue_status_network_error();
-    return false;
-}
\ No newline at end of file
+    bool acked = (c->result > 0);
+    c->cmdid = 0;
+    pthread_mutex_unlock(&g_mutex);
+    return acked;
+}
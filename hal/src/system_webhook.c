@@ -1,76 +1,393 @@
+#define _POSIX_C_SOURCE 200809L
 #include "hal/system_webhook.h"
-#include "discord_alert.h" 
+#include "hal/timing.h"
+#include "discord_alert.h"
+#include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
 
-// Simple singly-linked queue of strdup'd messages
-typedef struct msg_node {
-    char *msg;
-    struct msg_node *next;
-} msg_node_t;
+#define WEBHOOK_QUEUE_CAP        64      // messages held in memory
+#define WEBHOOK_SPOOL_MAX        4096    // undelivered messages allowed on disk
+#define WEBHOOK_BACKOFF_BASE_MS  500
+#define WEBHOOK_BACKOFF_MAX_MS   (5 * 60 * 1000)
+#define WEBHOOK_DRAIN_MS         3000    // last attempts at shutdown, no spool
+#define WEBHOOK_SPOOL_COMPACT    256     // "A" records that trigger a rewrite
+
+// Spool format (append-only, one record per line):
+//   M <seq> <enqueued_epoch_ms> <escaped message>
+//   A <seq>
+// Delivery is strictly in order, so the highest "A" record tells which "M"
+// records are still pending. The file is truncated once everything has been
+// delivered, and rewritten with only the pending records once
+// WEBHOOK_SPOOL_COMPACT acks have piled up before that. Records are written
+// under queue_lock, so the file keeps seq order, but flushed to disk
+// outside it.
+
+typedef struct {
+    unsigned long long seq;
+    long long enq_ms;                 // wall clock, so ages survive restarts
+    char msg[HUB_WEBHOOK_MSG_MAX];
+} webhook_msg_t;
 
 static pthread_t worker_thread;
 static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
-static msg_node_t *queue_head = NULL;
-static msg_node_t *queue_tail = NULL;
+static webhook_msg_t queue[WEBHOOK_QUEUE_CAP];
+static int queue_head = 0;
+static int queue_count = 0;
 static int running = 0;
 static char *g_webhook_url = NULL;
+static HubWebhookStats counters;
+
+// Spool state (protected by queue_lock)
+static char spool_path[256] = "";
+static bool spool_path_set = false;
+static int  spool_fd = -1;
+static int  spool_pending = 0;       // undelivered messages recorded on disk
+static int  spool_acked = 0;         // "A" records in the file
+static bool spilled = false;         // spool holds messages newer than the ring
+static off_t refill_off = 0;         // first spool byte not yet loaded
+static unsigned long long next_seq = 1;
+
+// ---------- ring helpers ----------
 
-static void enqueue_msg(const char *s)
+static webhook_msg_t *queue_tail_slot(void)
 {
-    if (!s) return;
-    msg_node_t *n = malloc(sizeof(*n));
-    if (!n) return;
-    n->msg = strdup(s);
-    n->next = NULL;
+    return &queue[(queue_head + queue_count) % WEBHOOK_QUEUE_CAP];
+}
 
-    pthread_mutex_lock(&queue_lock);
-    if (queue_tail) queue_tail->next = n; else queue_head = n;
-    queue_tail = n;
-    pthread_cond_signal(&queue_cond);
-    pthread_mutex_unlock(&queue_lock);
+static void queue_pop(void)
+{
+    queue_head = (queue_head + 1) % WEBHOOK_QUEUE_CAP;
+    queue_count--;
 }
 
-static char *dequeue_msg(void)
+// ---------- spool helpers ----------
+
+static bool write_all(int fd, const char *buf, size_t len)
 {
-    pthread_mutex_lock(&queue_lock);
-    while (running && queue_head == NULL) {
-        pthread_cond_wait(&queue_cond, &queue_lock);
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("hub_webhook: spool write");
+            return false;
+        }
+        buf += n;
+        len -= (size_t)n;
     }
-    if (!running && queue_head == NULL) {
-        pthread_mutex_unlock(&queue_lock);
-        return NULL;
+    return true;
+}
+
+static bool spool_write(const char *buf, size_t len)
+{
+    return write_all(spool_fd, buf, len);
+}
+
+static bool spool_append_msg(const webhook_msg_t *m)
+{
+    char line[HUB_WEBHOOK_MSG_MAX * 2 + 64];
+    int n = snprintf(line, sizeof(line), "M %llu %lld ", m->seq, m->enq_ms);
+    for (const char *p = m->msg; *p && n < (int)sizeof(line) - 3; p++) {
+        if (*p == '\\')      { line[n++] = '\\'; line[n++] = '\\'; }
+        else if (*p == '\n') { line[n++] = '\\'; line[n++] = 'n'; }
+        else if (*p == '\r') { line[n++] = '\\'; line[n++] = 'r'; }
+        else                 { line[n++] = *p; }
+    }
+    line[n++] = '\n';
+    return spool_write(line, (size_t)n);
+}
+
+static void spool_append_ack(unsigned long long seq)
+{
+    char line[32];
+    int n = snprintf(line, sizeof(line), "A %llu\n", seq);
+    spool_write(line, (size_t)n);
+}
+
+// Parse one spool line. Returns 'M', 'A' or 0 for a torn/garbage line.
+static char spool_parse(char *line, webhook_msg_t *m)
+{
+    int off = 0;
+    if (line[0] == 'A') {
+        if (sscanf(line, "A %llu", &m->seq) != 1) return 0;
+        return 'A';
+    }
+    if (line[0] != 'M') return 0;
+    if (sscanf(line, "M %llu %lld%n", &m->seq, &m->enq_ms, &off) != 2 ||
+        line[off] != ' ') {
+        return 0;
+    }
+    off++;
+    size_t n = 0;
+    for (const char *p = line + off; *p && *p != '\n' && n < sizeof(m->msg) - 1; p++) {
+        if (*p == '\\' && p[1]) {
+            p++;
+            m->msg[n++] = (*p == 'n') ? '\n' : (*p == 'r') ? '\r' : *p;
+        } else {
+            m->msg[n++] = *p;
+        }
+    }
+    m->msg[n] = '\0';
+    return 'M';
+}
+
+// Load pending records with seq > after_seq from refill_off into the ring
+// until it is full. Clears `spilled` once the end of the spool is reached.
+static void spool_refill(unsigned long long after_seq)
+{
+    FILE *f = fopen(spool_path, "r");
+    if (!f) return;
+    if (fseeko(f, refill_off, SEEK_SET) != 0) { fclose(f); return; }
+
+    char *line = NULL;
+    size_t cap = 0;
+    webhook_msg_t m;
+    spilled = false;
+    while (1) {
+        off_t at = ftello(f);
+        if (getline(&line, &cap, f) < 0) break;
+        if (spool_parse(line, &m) != 'M' || m.seq <= after_seq) continue;
+        if (queue_count == WEBHOOK_QUEUE_CAP) {
+            refill_off = at;
+            spilled = true;
+            break;
+        }
+        *queue_tail_slot() = m;
+        queue_count++;
+        after_seq = m.seq;
+    }
+    if (!spilled) refill_off = ftello(f);
+    free(line);
+    fclose(f);
+}
+
+// Open the spool and replay anything a previous run didn't deliver.
+static void spool_open(void)
+{
+    if (spool_path[0] == '\0') return;
+
+    spool_fd = open(spool_path, O_RDWR | O_CREAT | O_APPEND, 0600);
+    if (spool_fd < 0) {
+        fprintf(stderr, "hub_webhook: cannot open spool '%s': %s (memory-only)\n",
+                spool_path, strerror(errno));
+        return;
+    }
+
+    unsigned long long acked = 0, last = 0;
+    FILE *f = fopen(spool_path, "r");
+    if (f) {
+        char *line = NULL;
+        size_t cap = 0;
+        webhook_msg_t m;
+        while (getline(&line, &cap, f) >= 0) {
+            char kind = spool_parse(line, &m);
+            if (kind == 'A' && m.seq > acked) acked = m.seq;
+            if (kind == 'M' && m.seq > last)  last = m.seq;
+        }
+        rewind(f);
+        while (getline(&line, &cap, f) >= 0) {
+            if (spool_parse(line, &m) == 'M' && m.seq > acked) spool_pending++;
+        }
+        free(line);
+        fclose(f);
     }
-    msg_node_t *n = queue_head;
-    queue_head = n->next;
-    if (!queue_head) queue_tail = NULL;
+    next_seq = last + 1;
+
+    if (spool_pending == 0) {
+        if (ftruncate(spool_fd, 0) != 0) perror("hub_webhook: spool truncate");
+        return;
+    }
+    spool_acked = WEBHOOK_SPOOL_COMPACT;     // rewrite after the first delivery
+    refill_off = 0;
+    spool_refill(acked);
+    fprintf(stderr, "hub_webhook: replaying %d spooled message(s) from %s\n",
+            spool_pending, spool_path);
+}
+
+// ---------- worker ----------
+
+static long long backoff_ms(int attempt, unsigned int *seed)
+{
+    long long cap = WEBHOOK_BACKOFF_BASE_MS;
+    for (int i = 1; i < attempt && cap < WEBHOOK_BACKOFF_MAX_MS; i++) cap *= 2;
+    if (cap > WEBHOOK_BACKOFF_MAX_MS) cap = WEBHOOK_BACKOFF_MAX_MS;
+    // "equal jitter": half fixed, half random, so retries from several
+    // hubs don't synchronise against the webhook's rate limiter
+    return cap / 2 + rand_r(seed) % (cap / 2 + 1);
+}
+
+static void delivered_head(unsigned long long seq)
+{
+    queue_pop();
+    counters.delivered++;
+    if (spool_fd < 0) return;
+
+    spool_append_ack(seq);
+    spool_acked++;
+    if (spool_pending > 0) spool_pending--;
+    if (spilled && queue_count < WEBHOOK_QUEUE_CAP) {
+        int last = (queue_head + queue_count - 1) % WEBHOOK_QUEUE_CAP;
+        spool_refill(queue_count ? queue[last].seq : seq);
+    }
+    if (queue_count == 0 && !spilled) {
+        if (ftruncate(spool_fd, 0) != 0) perror("hub_webhook: spool truncate");
+        refill_off = 0;
+        spool_pending = 0;
+        spool_acked = 0;
+    }
+}
+
+// Replace the spool with its records after `acked`. Called by the worker
+// with queue_lock held; the copy and its flush run without it. Only the
+// worker acks, so the first `end` bytes don't change meanwhile. Records
+// senders append meanwhile are copied over under the lock before the
+// rename.
+static void spool_compact(unsigned long long acked)
+{
+    char tmp_path[sizeof(spool_path) + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", spool_path);
+    off_t end = lseek(spool_fd, 0, SEEK_END);
     pthread_mutex_unlock(&queue_lock);
 
-    char *m = n->msg;
-    free(n);
-    return m;
+    bool ok = false;
+    int fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0600);
+    FILE *f = fopen(spool_path, "r");
+    if (fd >= 0 && f && end >= 0) {
+        char *line = NULL;
+        size_t cap = 0;
+        webhook_msg_t m;
+        ok = true;
+        while (ok && ftello(f) < end) {
+            ssize_t n = getline(&line, &cap, f);
+            if (n < 0) break;
+            if (spool_parse(line, &m) == 'M' && m.seq > acked) {
+                ok = write_all(fd, line, (size_t)n);
+            }
+        }
+        free(line);
+        ok = ok && fdatasync(fd) == 0;
+    }
+    if (f) fclose(f);
+
+    pthread_mutex_lock(&queue_lock);
+    off_t now_end = ok ? lseek(spool_fd, 0, SEEK_END) : -1;
+    for (off_t at = end; ok && at < now_end; ) {
+        char buf[4096];
+        size_t want = (size_t)(now_end - at) < sizeof(buf) ? (size_t)(now_end - at)
+                                                          : sizeof(buf);
+        ssize_t n = pread(spool_fd, buf, want, at);
+        ok = n > 0 && write_all(fd, buf, (size_t)n);
+        at += n > 0 ? n : 0;
+    }
+    if (ok && now_end > end) ok = fdatasync(fd) == 0;
+    if (ok && rename(tmp_path, spool_path) == 0) {
+        close(spool_fd);
+        spool_fd = fd;
+        refill_off = 0;
+        spool_acked = 0;
+        return;
+    }
+    fprintf(stderr, "hub_webhook: spool compaction failed, keeping %s\n", spool_path);
+    if (fd >= 0) close(fd);
+    unlink(tmp_path);
+    spool_acked = 0;     // try again after as many acks
 }
 
 static void *worker(void *arg)
 {
     (void)arg;
+    unsigned int seed = (unsigned int)getTimeInUs();
+    int attempt = 0;
+    webhook_msg_t m;
+
     while (1) {
-        char *m = dequeue_msg();
-        if (!m) break;
-        if (g_webhook_url) {
-            sendDiscordAlert(g_webhook_url, m);
+        pthread_mutex_lock(&queue_lock);
+        while (running && queue_count == 0) {
+            pthread_cond_wait(&queue_cond, &queue_lock);
+        }
+        if (!running) {
+            pthread_mutex_unlock(&queue_lock);
+            break;
+        }
+        m = queue[queue_head];
+        pthread_mutex_unlock(&queue_lock);
+
+        bool ok = g_webhook_url && sendDiscordAlert(g_webhook_url, m.msg);
+
+        pthread_mutex_lock(&queue_lock);
+        if (ok) {
+            attempt = 0;
+            delivered_head(m.seq);
+            if (spool_fd >= 0 && spool_acked >= WEBHOOK_SPOOL_COMPACT) {
+                spool_compact(m.seq);
+            }
+            pthread_mutex_unlock(&queue_lock);
+            continue;
         }
-        free(m);
+
+        counters.retries++;
+        long long delay = backoff_ms(++attempt, &seed);
+        fprintf(stderr, "hub_webhook: delivery of #%llu failed, retry %d in %lld ms\n",
+                m.seq, attempt, delay);
+
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec  += delay / 1000;
+        ts.tv_nsec += (delay % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) { ts.tv_sec++; ts.tv_nsec -= 1000000000L; }
+        while (running) {
+            if (pthread_cond_timedwait(&queue_cond, &queue_lock, &ts) == ETIMEDOUT) break;
+        }
+        pthread_mutex_unlock(&queue_lock);
+    }
+
+    // Without a spool, make one last attempt at whatever is still queued,
+    // for at most WEBHOOK_DRAIN_MS and only while deliveries succeed: with
+    // the network down every attempt costs a full curl timeout. The rest
+    // is dropped and counted.
+    if (spool_fd < 0) {
+        long long deadline = getTimeInMs() + WEBHOOK_DRAIN_MS;
+        pthread_mutex_lock(&queue_lock);
+        while (queue_count > 0 && g_webhook_url && getTimeInMs() < deadline) {
+            m = queue[queue_head];
+            pthread_mutex_unlock(&queue_lock);
+            bool ok = sendDiscordAlert(g_webhook_url, m.msg);
+            pthread_mutex_lock(&queue_lock);
+            if (!ok) break;
+            delivered_head(m.seq);
+        }
+        if (queue_count > 0) {
+            fprintf(stderr, "hub_webhook: dropping %d undelivered message(s) at shutdown\n",
+                    queue_count);
+            counters.dropped += queue_count;
+            queue_head = queue_count = 0;
+        }
+        pthread_mutex_unlock(&queue_lock);
     }
     return NULL;
 }
 
+// ---------- public API ----------
+
+void hub_webhook_set_spool_path(const char *path)
+{
+    pthread_mutex_lock(&queue_lock);
+    snprintf(spool_path, sizeof(spool_path), "%s", path ? path : "");
+    spool_path_set = true;
+    pthread_mutex_unlock(&queue_lock);
+}
+
 bool hub_webhook_init(const char *webhook_url)
 {
     if (webhook_url == NULL) return false;
+    if (running) return false;
 
     // store URL
     g_webhook_url = strdup(webhook_url);
@@ -82,14 +399,32 @@ bool hub_webhook_init(const char *webhook_url)
         return false;
     }
 
+    pthread_mutex_lock(&queue_lock);
+    if (!spool_path_set) {
+        const char *env = getenv("HUB_WEBHOOK_SPOOL");
+        snprintf(spool_path, sizeof(spool_path), "%s",
+                 env ? env : HUB_WEBHOOK_DEFAULT_SPOOL);
+    }
+    queue_head = queue_count = 0;
+    spool_pending = 0;
+    spool_acked = 0;
+    spilled = false;
+    refill_off = 0;
+    next_seq = 1;
+    memset(&counters, 0, sizeof(counters));
+    spool_open();
+
     running = 1;
     if (pthread_create(&worker_thread, NULL, worker, NULL) != 0) {
         running = 0;
+        if (spool_fd >= 0) { close(spool_fd); spool_fd = -1; }
+        pthread_mutex_unlock(&queue_lock);
         discordCleanup();
         free(g_webhook_url);
         g_webhook_url = NULL;
         return false;
     }
+    pthread_mutex_unlock(&queue_lock);
     return true;
 }
 
@@ -97,22 +432,26 @@ void hub_webhook_shutdown(void)
 {
     // stop worker
     pthread_mutex_lock(&queue_lock);
+    if (!running) {
+        pthread_mutex_unlock(&queue_lock);
+        return;
+    }
     running = 0;
     pthread_cond_signal(&queue_cond);
     pthread_mutex_unlock(&queue_lock);
 
     pthread_join(worker_thread, NULL);
 
-    // drain and free any remaining messages
     pthread_mutex_lock(&queue_lock);
-    msg_node_t *n = queue_head;
-    while (n) {
-        msg_node_t *next = n->next;
-        free(n->msg);
-        free(n);
-        n = next;
-    }
-    queue_head = queue_tail = NULL;
+    if (spool_fd >= 0) {
+        if (spool_pending > 0) {
+            fprintf(stderr, "hub_webhook: %d undelivered message(s) kept in %s\n",
+                    spool_pending, spool_path);
+        }
+        close(spool_fd);
+        spool_fd = -1;
+    }
+    queue_head = queue_count = 0;
     pthread_mutex_unlock(&queue_lock);
 
     if (g_webhook_url) {
@@ -122,14 +461,71 @@ void hub_webhook_shutdown(void)
     }
 }
 
-void hub_webhook_send(const char *msg)
+bool hub_webhook_send(const char *msg)
 {
-    if (!msg) return;
+    if (!msg) return false;
     pthread_mutex_lock(&queue_lock);
     if (!running) {
         pthread_mutex_unlock(&queue_lock);
-        return;
+        return false;
+    }
+
+    bool full = (spool_fd >= 0) ? (spool_pending >= WEBHOOK_SPOOL_MAX)
+                                : (queue_count >= WEBHOOK_QUEUE_CAP);
+    if (full) {
+        counters.dropped++;
+        pthread_mutex_unlock(&queue_lock);
+        fprintf(stderr, "hub_webhook: queue full, dropping '%s'\n", msg);
+        return false;
     }
+
+    webhook_msg_t m;
+    m.seq = next_seq++;
+    m.enq_ms = getTimeInMs();
+    snprintf(m.msg, sizeof(m.msg), "%s", msg);
+
+    bool on_disk = (spool_fd >= 0) && spool_append_msg(&m);
+    if (on_disk) spool_pending++;
+    // Flushed after the lock is released, so neither the worker nor other
+    // senders wait for the disk. The duplicate keeps the file open should
+    // shutdown or a compaction replace spool_fd meanwhile.
+    int sync_fd = on_disk ? dup(spool_fd) : -1;
+
+    bool queued = true;
+    if (!spilled && queue_count < WEBHOOK_QUEUE_CAP) {
+        *queue_tail_slot() = m;
+        queue_count++;
+    } else if (on_disk) {
+        spilled = true;      // the worker picks it up from the spool later
+    } else {
+        counters.dropped++;
+        queued = false;
+    }
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+    if (sync_fd >= 0) {
+        fdatasync(sync_fd);
+        close(sync_fd);
+    }
+    return queued;
+}
+
+bool hub_webhook_is_running(void)
+{
+    pthread_mutex_lock(&queue_lock);
+    bool r = running;
+    pthread_mutex_unlock(&queue_lock);
+    return r;
+}
+
+void hub_webhook_get_stats(HubWebhookStats *out)
+{
+    if (!out) return;
+    pthread_mutex_lock(&queue_lock);
+    *out = counters;
+    out->mem_depth = queue_count;
+    out->depth = (spool_fd >= 0 && spool_pending > queue_count) ? spool_pending
+                                                                 : queue_count;
+    out->oldest_age_ms = queue_count ? getTimeInMs() - queue[queue_head].enq_ms : 0;
     pthread_mutex_unlock(&queue_lock);
-    enqueue_msg(msg);
 }
@@ -0,0 +1,94 @@
+#!/usr/bin/env bash
+# JSON vs CBOR responses from the hub HTTP API. Starts door_system (local
+# module HUB), fills the history from MODULES stand-in door modules, then
+# for each endpoint fetches REQUESTS responses pipelined PIPE at a time on
+# one connection, once with the default JSON and once with
+# Accept: application/cbor, and prints the body size and request rate.
+# Status comes from the hub's cache; the history pages are encoded on
+# every request, so their rate shows the encoder's cost.
+#
+# Usage: scripts/format_bench.sh [REQUESTS] [MODULES] [BUILD_DIR] [PIPE]
+REQUESTS=${1:-20000}
+MODULES=${2:-8}
+BUILD=${3:-build}
+PIPE=${4:-16}
+WORK=$(mktemp -d)
+trap 'kill $HUB_PID 2>/dev/null; rm -rf "$WORK"' EXIT
+
+mkfifo "$WORK/stdin"
+# Alerts go to a closed local port so the run never reaches Discord.
+HUB_WEBHOOK_URL="http://127.0.0.1:9/" HUB_WEBHOOK_SPOOL="" HUB_WEBHOOK_DEVICE="" \
+    "$BUILD/app/door_system" HUB < "$WORK/stdin" \
+    > "$WORK/hub.log" 2>&1 &
+HUB_PID=$!
+exec 3> "$WORK/stdin"
+sleep 1
+
+cat > "$WORK/bench.js" <<'EOF'
+const dgram = require('dgram'), net = require('net');
+const [REQUESTS, MODULES, PIPE] = process.argv.slice(2).map(Number);
+const PATHS = ['/api/status?module=M1', '/api/status/all',
+               '/api/history?limit=50', '/api/history?limit=256'];
+
+// Write `count` GETs of `path` in batches of `depth` and time the replies;
+// reconnects whenever the server closes (request cap).
+function pipelined(path, accept, count, depth) {
+  const GET = `GET ${path} HTTP/1.1\r\nHost: x\r\n${accept}\r\n`;
+  return new Promise((resolve) => {
+    let done = 0, size = 0;
+    const t0 = process.hrtime.bigint();
+    const open = () => {
+      const s = net.connect(8080, '127.0.0.1');
+      let buf = Buffer.alloc(0), inflight = 0, ok = true;
+      const fill = () => {
+        const n = Math.min(depth, count - done - inflight);
+        if (n > 0) { s.write(GET.repeat(n)); inflight += n; }
+      };
+      s.on('connect', fill);
+      s.on('data', (d) => {
+        buf = Buffer.concat([buf, d]);
+        let i;
+        while ((i = buf.indexOf('\r\n\r\n')) >= 0) {
+          const head = buf.subarray(0, i).toString();
+          const len = +/Content-Length: (\d+)/i.exec(head)[1];
+          if (buf.length < i + 4 + len) break;
+          if (/Connection: close/i.test(head)) ok = false;
+          size = len;
+          buf = buf.subarray(i + 4 + len); done++; inflight--;
+        }
+        if (done >= count) {
+          s.destroy();
+          resolve({ size, rate: count / (Number(process.hrtime.bigint() - t0) / 1e9) });
+        } else if (ok && inflight === 0) fill();
+      });
+      s.on('close', () => { if (done < count) open(); });
+    };
+    open();
+  });
+}
+
+(async () => {
+  // Stand-in modules: enough heartbeats to fill the 256-entry history.
+  const s = dgram.createSocket('udp4');
+  await new Promise((r) => s.bind(0, '127.0.0.1', r));
+  for (let k = 0; k < 300; k++) {
+    const m = `M${1 + k % MODULES}`;
+    s.send(`${m} HEARTBEAT D0=CLOSED,LOCKED D1=OPEN,UNLOCKED\n`, 12345, '127.0.0.1');
+    await new Promise((r) => setImmediate(r));
+  }
+  await new Promise((r) => setTimeout(r, 300));
+  s.close();
+
+  console.log(`${REQUESTS} requests per row, pipelined x${PIPE}, ${MODULES} modules`);
+  for (const path of PATHS) {
+    const json = await pipelined(path, '', REQUESTS, PIPE);
+    const cbor = await pipelined(path, 'Accept: application/cbor\r\n', REQUESTS, PIPE);
+    console.log(`${path.padEnd(24)} json ${String(json.size).padStart(6)} B ` +
+                `${json.rate.toFixed(0).padStart(6)} req/s   cbor ${String(cbor.size).padStart(6)} B ` +
+                `${cbor.rate.toFixed(0).padStart(6)} req/s`);
+  }
+})();
+EOF
+
+node "$WORK/bench.js" "$REQUESTS" "$MODULES" "$PIPE"
+echo q >&3
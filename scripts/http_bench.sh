@@ -0,0 +1,160 @@
+#!/usr/bin/env bash
+# Concurrent HTTP API throughput against a running-from-scratch hub.
+# Starts door_system (local module HUB), registers two stand-in door
+# modules over UDP -- M1 answers COMMANDs with FEEDBACK after ACK_DELAY ms,
+# M2 never answers -- then keeps CONC status polls in flight while POST
+# /api/command requests to both modules are outstanding, and prints status
+# throughput/latency plus command round-trips. A second phase measures a
+# single client: a new connection per request, one keep-alive connection,
+# and requests pipelined PIPE at a time on one connection.
+#
+# Usage: scripts/http_bench.sh [REQUESTS] [CONC] [ACK_DELAY] [BUILD_DIR] [PIPE]
+REQUESTS=${1:-5000}
+CONC=${2:-32}
+ACK_DELAY=${3:-50}
+BUILD=${4:-build}
+PIPE=${5:-16}
+WORK=$(mktemp -d)
+trap 'kill $HUB_PID 2>/dev/null; rm -rf "$WORK"' EXIT
+
+mkfifo "$WORK/stdin"
+# Alerts go to a closed local port so the run never reaches Discord.
+HUB_WEBHOOK_URL="http://127.0.0.1:9/" HUB_WEBHOOK_SPOOL="" HUB_WEBHOOK_DEVICE="" \
+    "$BUILD/app/door_system" HUB < "$WORK/stdin" \
+    > "$WORK/hub.log" 2>&1 &
+HUB_PID=$!
+exec 3> "$WORK/stdin"
+sleep 1
+
+cat > "$WORK/bench.js" <<'EOF'
+const http = require('http'), dgram = require('dgram'), net = require('net');
+const [REQUESTS, CONC, ACK_DELAY, PIPE] = process.argv.slice(2).map(Number);
+const agent = new http.Agent({ keepAlive: false, maxSockets: Infinity });
+
+// Stand-in modules: M1 acknowledges commands, M2 stays silent.
+function module(id, ack) {
+  const s = dgram.createSocket('udp4');
+  s.on('message', (msg) => {
+    const [mod, type, cmdid, target, action] = msg.toString().trim().split(/\s+/);
+    if (!ack || type !== 'COMMAND') return;
+    // Like door_udp, answer on the hub's notification port.
+    setTimeout(() => s.send(`${mod} FEEDBACK ${cmdid} ${target} ${action}\n`,
+                            12345, '127.0.0.1'), ACK_DELAY);
+  });
+  s.bind(0, '127.0.0.1', () => {
+    const hb = () => s.send(`${id} HEARTBEAT D0=CLOSED,LOCKED D1=CLOSED,LOCKED\n`,
+                            12345, '127.0.0.1');
+    hb(); setInterval(hb, 1000).unref();
+  });
+  return s;
+}
+
+function request(method, path, body, via = agent) {
+  return new Promise((resolve) => {
+    const t0 = process.hrtime.bigint();
+    const req = http.request({ host: '127.0.0.1', port: 8080, method, path, agent: via,
+      headers: body ? { 'Content-Type': 'application/x-www-form-urlencoded',
+                        'Content-Length': Buffer.byteLength(body) } : {} }, (res) => {
+      let data = '';
+      res.on('data', (c) => data += c);
+      res.on('end', () => resolve({ ms: Number(process.hrtime.bigint() - t0) / 1e6, data }));
+    });
+    req.on('error', (e) => resolve({ ms: -1, data: e.message }));
+    if (body) req.write(body);
+    req.end();
+  });
+}
+
+// Write `count` GETs in batches of `depth` on raw sockets and count the
+// responses; reconnects whenever the server closes (request cap).
+function pipelined(count, depth) {
+  const GET = 'GET /api/status?module=M1 HTTP/1.1\r\nHost: x\r\n\r\n';
+  return new Promise((resolve) => {
+    let done = 0;
+    const open = () => {
+      const s = net.connect(8080, '127.0.0.1');
+      let buf = '', inflight = 0, ok = true;
+      const fill = () => {
+        const n = Math.min(depth, count - done - inflight);
+        if (n > 0) { s.write(GET.repeat(n)); inflight += n; }
+      };
+      s.on('connect', fill);
+      s.on('data', (d) => {
+        buf += d;
+        let i;
+        while ((i = buf.indexOf('\r\n\r\n')) >= 0) {
+          const len = +/Content-Length: (\d+)/i.exec(buf.slice(0, i))[1];
+          if (buf.length < i + 4 + len) break;
+          if (/Connection: close/i.test(buf.slice(0, i))) ok = false;
+          buf = buf.slice(i + 4 + len); done++; inflight--;
+        }
+        if (done >= count) { s.destroy(); resolve(); }
+        else if (ok && inflight === 0) fill();
+      });
+      s.on('close', () => { if (done < count) open(); });
+    };
+    open();
+  });
+}
+
+async function singleClient(n, pipe) {
+  const keep = new http.Agent({ keepAlive: true, maxSockets: 1 });
+  for (const [name, via] of [['new connection', agent], ['keep-alive', keep]]) {
+    const t0 = Date.now();
+    for (let i = 0; i < n; i++) await request('GET', '/api/status?module=M1', null, via);
+    console.log(`single client, ${name}: ${(n / ((Date.now() - t0) / 1000)).toFixed(0)} req/s`);
+  }
+  keep.destroy();
+  const t0 = Date.now();
+  await pipelined(n, pipe);
+  console.log(`single client, pipelined x${pipe}: ${(n / ((Date.now() - t0) / 1000)).toFixed(0)} req/s`);
+}
+
+const pct = (a, p) => a[Math.min(a.length - 1, Math.floor(a.length * p))].toFixed(2);
+
+(async () => {
+  const sockets = [module('M1', true), module('M2', false)];
+  await new Promise((r) => setTimeout(r, 500));
+
+  // Commands outstanding for the whole run: acked ones back to back on M1,
+  // one to the silent M2 that only resolves when the hub gives up.
+  let running = true;
+  const cmdLat = [];
+  const acked = (async () => {
+    while (running) {
+      const r = await request('POST', '/api/command', 'module=M1&target=D1&action=LOCK');
+      if (r.data.includes('"ack":true')) cmdLat.push(r.ms);
+    }
+  })();
+  const silent = request('POST', '/api/command', 'module=M2&target=D1&action=LOCK');
+
+  const lat = [];
+  let next = 0, errors = 0;
+  const t0 = Date.now();
+  await Promise.all(Array.from({ length: CONC }, async () => {
+    while (next++ < REQUESTS) {
+      const r = await request('GET', '/api/status?module=M1');
+      if (r.ms < 0) errors++; else lat.push(r.ms);
+    }
+  }));
+  const secs = (Date.now() - t0) / 1000;
+  running = false;
+  await acked;
+  const s = await silent;
+
+  lat.sort((a, b) => a - b); cmdLat.sort((a, b) => a - b);
+  console.log(`status: ${lat.length} ok, ${errors} errors in ${secs.toFixed(2)} s ` +
+              `= ${(lat.length / secs).toFixed(0)} req/s (concurrency ${CONC})`);
+  console.log(`status latency ms: p50 ${pct(lat, 0.5)}  p99 ${pct(lat, 0.99)}  max ${pct(lat, 1)}`);
+  if (cmdLat.length)
+    console.log(`command to M1 (ack after ${ACK_DELAY} ms): ${cmdLat.length} acked, ` +
+                `p50 ${pct(cmdLat, 0.5)} ms  max ${pct(cmdLat, 1)} ms`);
+  console.log(`command to silent M2: ${s.ms.toFixed(0)} ms -> ${s.data}`);
+
+  await singleClient(REQUESTS, PIPE);
+  sockets.forEach((s) => s.close());
+})();
+EOF
+
+node "$WORK/bench.js" "$REQUESTS" "$CONC" "$ACK_DELAY" "$PIPE"
+echo q >&3
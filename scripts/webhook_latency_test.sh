@@ -0,0 +1,40 @@
+#!/usr/bin/env bash
+# Per-alert webhook latency against a local HTTPS stand-in server.
+# Starts a keep-alive HTTPS server on 127.0.0.1:$PORT with a throwaway
+# self-signed cert, runs door_system pointed at it, fires COUNT door
+# EVENTs at the hub and prints the sender's latency/connection counters.
+#
+# Usage: scripts/webhook_latency_test.sh [COUNT] [PORT] [BUILD_DIR]
+COUNT=${1:-20}
+PORT=${2:-8443}
+BUILD=${3:-build}
+WORK=$(mktemp -d)
+trap 'kill $STANDIN_PID 2>/dev/null; rm -rf "$WORK"' EXIT
+
+openssl req -x509 -newkey rsa:2048 -nodes -days 1 -subj "/CN=127.0.0.1" \
+    -addext "subjectAltName=IP:127.0.0.1" \
+    -keyout "$WORK/key.pem" -out "$WORK/cert.pem" 2>/dev/null
+
+node -e "
+const https = require('https'), fs = require('fs');
+https.createServer({ key: fs.readFileSync('$WORK/key.pem'),
+                     cert: fs.readFileSync('$WORK/cert.pem') },
+  (req, res) => { req.resume(); req.on('end', () => { res.writeHead(204); res.end(); }); }
+).listen($PORT, '127.0.0.1');
+" &
+STANDIN_PID=$!
+sleep 1
+
+{
+  sleep 1
+  for i in $(seq 1 "$COUNT"); do
+    if (( i % 2 )); then state=OPEN; else state=CLOSED; fi
+    echo "D1 EVENT D0 DOOR $state" > /dev/udp/127.0.0.1/12345
+    sleep 0.2
+  done
+  sleep 1
+  echo w
+  echo q
+} | HUB_WEBHOOK_URL="https://127.0.0.1:$PORT/webhook" HUB_WEBHOOK_DEVICE="" \
+    DISCORD_CAINFO="$WORK/cert.pem" "$BUILD/app/door_system" 2>&1 \
+  | grep -E "Discord:|Webhook:"
@@ -0,0 +1,161 @@
+#!/usr/bin/env bash
+# Command round-trip latency from a browser-side client to a door module
+# and back, over loopback. Starts door_system (local module HUB), a
+# stand-in module M1 that answers COMMANDs with FEEDBACK after ACK_DELAY ms,
+# and the Node bridge (gui/lib/door_server.js) on NODE_PORT, then issues
+# ROUNDS commands one at a time over each path:
+#   socket.io  browser -> Node -> UDP hub -> module -> hub -> Node -> browser
+#   http       POST /api/command on one keep-alive connection
+#   websocket  /api/ws on the hub's own HTTP server
+# and prints the latency distribution of each.
+#
+# Needs the gui dependencies (cd gui && npm install) for socket.io and ws.
+#
+# Usage: scripts/ws_bench.sh [ROUNDS] [ACK_DELAY] [BUILD_DIR] [NODE_PORT]
+ROUNDS=${1:-500}
+ACK_DELAY=${2:-0}
+BUILD=${3:-build}
+NODE_PORT=${4:-3100}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+trap 'kill $HUB_PID $NODE_PID 2>/dev/null; rm -rf "$WORK"' EXIT
+
+mkfifo "$WORK/stdin"
+# Alerts go to a closed local port so the run never reaches Discord.
+HUB_WEBHOOK_URL="http://127.0.0.1:9/" HUB_WEBHOOK_SPOOL="" HUB_WEBHOOK_DEVICE="" \
+    "$BUILD/app/door_system" HUB < "$WORK/stdin" \
+    > "$WORK/hub.log" 2>&1 &
+HUB_PID=$!
+exec 3> "$WORK/stdin"
+
+# The Node bridge exactly as the web UI runs it, minus the static files.
+HUB_HOST=127.0.0.1 HUB_PORT=12345 NODE_PATH="$ROOT/gui/node_modules" node -e "
+  const server = require('http').createServer();
+  require('$ROOT/gui/lib/door_server').listen(server);
+  server.listen($NODE_PORT, '127.0.0.1');
+" > "$WORK/node.log" 2>&1 &
+NODE_PID=$!
+sleep 1
+
+cat > "$WORK/bench.js" <<'EOF'
+const dgram = require('dgram'), http = require('http');
+const WebSocket = require('ws');
+const [ROUNDS, ACK_DELAY, NODE_PORT] = process.argv.slice(2).map(Number);
+const CMD = { module: 'M1', target: 'D0', action: 'LOCK' };
+
+// Stand-in module: like door_udp, answers on the hub's notification port.
+const mod = dgram.createSocket('udp4');
+mod.on('message', (msg) => {
+  const [m, type, cmdid, target, action] = msg.toString().trim().split(/\s+/);
+  if (type !== 'COMMAND') return;
+  const reply = () => mod.send(`${m} FEEDBACK ${cmdid} ${target} ${action}\n`,
+                               12345, '127.0.0.1');
+  if (ACK_DELAY > 0) setTimeout(reply, ACK_DELAY); else reply();
+});
+
+const open = (url) => new Promise((resolve) => {
+  const ws = new WebSocket(url);
+  ws.on('open', () => resolve(ws));
+});
+
+// Run `once` ROUNDS times back to back and collect the latencies.
+async function measure(once) {
+  const lat = [];
+  for (let i = 0; i < ROUNDS; i++) {
+    const t0 = process.hrtime.bigint();
+    if (await once(i)) lat.push(Number(process.hrtime.bigint() - t0) / 1e6);
+  }
+  return lat;
+}
+
+// socket.io spoken directly on its WebSocket transport (Engine.IO v4):
+// "0" open, "40" connect, "2"/"3" ping/pong, "42[...]" events.
+async function socketio() {
+  const ws = await open(`ws://127.0.0.1:${NODE_PORT}/socket.io/?EIO=4&transport=websocket`);
+  let waiter = null, seen = 0;
+  const ready = new Promise((resolve) => {
+    ws.on('message', (d) => {
+      const s = d.toString();
+      if (s[0] === '0') ws.send('40');
+      else if (s.startsWith('40')) resolve();
+      else if (s === '2') ws.send('3');
+      else if (s.startsWith('42')) {
+        const [name, data] = JSON.parse(s.slice(2));
+        // The bridge sends command-feedback to the requester and again to
+        // every client; take the first copy of each cmdid.
+        if (name === 'command-feedback' && data.cmdid > seen && waiter) {
+          seen = data.cmdid;
+          const w = waiter; waiter = null; w(true);
+        } else if (name === 'command-error' && waiter) {
+          const w = waiter; waiter = null; w(false);
+        }
+      }
+    });
+  });
+  await ready;
+  const lat = await measure(() => new Promise((resolve) => {
+    waiter = resolve;
+    ws.send('42' + JSON.stringify(['send-command', CMD]));
+  }));
+  ws.close();
+  return lat;
+}
+
+async function httpPost() {
+  const agent = new http.Agent({ keepAlive: true, maxSockets: 1 });
+  const body = `module=${CMD.module}&target=${CMD.target}&action=${CMD.action}`;
+  const lat = await measure(() => new Promise((resolve) => {
+    const req = http.request({ host: '127.0.0.1', port: 8080, method: 'POST',
+      path: '/api/command', agent, headers: {
+        'Content-Type': 'application/x-www-form-urlencoded',
+        'Content-Length': Buffer.byteLength(body) } }, (res) => {
+      let data = '';
+      res.on('data', (c) => data += c);
+      res.on('end', () => resolve(data.includes('"ack":true')));
+    });
+    req.on('error', () => resolve(false));
+    req.end(body);
+  }));
+  agent.destroy();
+  return lat;
+}
+
+async function websocket() {
+  const ws = await open('ws://127.0.0.1:8080/api/ws?types=none');
+  let waiter = null;
+  ws.on('message', (d) => {
+    const r = JSON.parse(d.toString());
+    if (r.type === 'result' && waiter) { const w = waiter; waiter = null; w(r.ack === true); }
+  });
+  const lat = await measure((i) => new Promise((resolve) => {
+    waiter = resolve;
+    ws.send(`module=${CMD.module}&target=${CMD.target}&action=${CMD.action}&id=${i}`);
+  }));
+  ws.close();
+  return lat;
+}
+
+function report(name, lat) {
+  lat.sort((a, b) => a - b);
+  const pct = (p) => lat[Math.min(lat.length - 1, Math.floor(lat.length * p))].toFixed(3);
+  const mean = lat.reduce((a, b) => a + b, 0) / lat.length;
+  console.log(`${name.padEnd(10)} ${String(lat.length).padStart(5)} ok  mean ${mean.toFixed(3)}  ` +
+              `p50 ${pct(0.5)}  p99 ${pct(0.99)}  max ${pct(1)} ms`);
+}
+
+mod.bind(0, '127.0.0.1', async () => {
+  const hb = () => mod.send('M1 HEARTBEAT D0=CLOSED,LOCKED D1=CLOSED,LOCKED\n',
+                            12345, '127.0.0.1');
+  hb(); setInterval(hb, 1000).unref();
+  await new Promise((r) => setTimeout(r, 300));
+
+  console.log(`${ROUNDS} sequential commands to M1 (ack after ${ACK_DELAY} ms)`);
+  report('socket.io', await socketio());
+  report('http', await httpPost());
+  report('websocket', await websocket());
+  mod.close();
+});
+EOF
+
+NODE_PATH="$ROOT/gui/node_modules" node "$WORK/bench.js" "$ROUNDS" "$ACK_DELAY" "$NODE_PORT"
+echo q >&3